@@ -84,7 +84,11 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
-static void select_sector (struct disk *, disk_sector_t);
+static void select_sector (struct disk *, disk_sector_t, size_t cnt);
+static void read_sectors (struct disk *, disk_sector_t, size_t cnt,
+		uint8_t *buffer, void *const bufs[]);
+static void write_sectors (struct disk *, disk_sector_t, size_t cnt,
+		const uint8_t *buffer, const void *const bufs[]);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -209,44 +213,109 @@ disk_size (struct disk *d) {
    per-disk locking is unneeded. */
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
+	disk_read_multiple (d, sec_no, 1, buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   DISK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
+	disk_write_multiple (d, sec_no, 1, buffer);
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFER, which must have room for CNT * DISK_SECTOR_SIZE bytes,
+   with a single command.  CNT must be between 1 and 256.  The
+   disk interrupts once per sector, but the channel is selected
+   and locked only once. */
+void
+disk_read_multiple (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		void *buffer) {
+	ASSERT (buffer != NULL);
+	read_sectors (d, sec_no, cnt, buffer, NULL);
+}
+
+/* Writes the CNT sectors starting at SEC_NO on disk D from
+   BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes, with a
+   single command.  CNT must be between 1 and 256.  Returns after
+   the disk has acknowledged receiving all of the data. */
+void
+disk_write_multiple (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		const void *buffer) {
+	ASSERT (buffer != NULL);
+	write_sectors (d, sec_no, cnt, buffer, NULL);
+}
+
+/* As disk_read_multiple(), but reads the I'th sector into
+   BUFS[I], which must have room for DISK_SECTOR_SIZE bytes. */
+void
+disk_read_scatter (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		void *const bufs[]) {
+	ASSERT (bufs != NULL);
+	read_sectors (d, sec_no, cnt, NULL, bufs);
+}
+
+/* As disk_write_multiple(), but writes the I'th sector from
+   BUFS[I], which must contain DISK_SECTOR_SIZE bytes. */
+void
+disk_write_gather (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		const void *const bufs[]) {
+	ASSERT (bufs != NULL);
+	write_sectors (d, sec_no, cnt, NULL, bufs);
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D with a single
+   command, into BUFFER if it is nonnull, otherwise into BUFS. */
+static void
+read_sectors (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		uint8_t *buffer, void *const bufs[]) {
 	struct channel *c;
 
 	ASSERT (d != NULL);
-	ASSERT (buffer != NULL);
+	ASSERT (cnt > 0 && cnt <= 256);
 
 	c = d->channel;
 	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
+	select_sector (d, sec_no, cnt);
 	issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-	sema_down (&c->completion_wait);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-	input_sector (c, buffer);
-	d->read_cnt++;
+	for (size_t i = 0; i < cnt; i++) {
+		sema_down (&c->completion_wait);
+		if (!wait_while_busy (d))
+			PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name,
+					sec_no + (disk_sector_t) i);
+		input_sector (c, buffer != NULL
+				? buffer + i * DISK_SECTOR_SIZE : bufs[i]);
+	}
+	d->read_cnt += cnt;
 	lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   DISK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
-void
-disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
+/* Writes CNT sectors starting at SEC_NO on disk D with a single
+   command, from BUFFER if it is nonnull, otherwise from BUFS. */
+static void
+write_sectors (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		const uint8_t *buffer, const void *const bufs[]) {
 	struct channel *c;
 
 	ASSERT (d != NULL);
-	ASSERT (buffer != NULL);
+	ASSERT (cnt > 0 && cnt <= 256);
 
 	c = d->channel;
 	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
+	select_sector (d, sec_no, cnt);
 	issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-	output_sector (c, buffer);
-	sema_down (&c->completion_wait);
-	d->write_cnt++;
+	for (size_t i = 0; i < cnt; i++) {
+		if (!wait_while_busy (d))
+			PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name,
+					sec_no + (disk_sector_t) i);
+		output_sector (c, buffer != NULL
+				? buffer + i * DISK_SECTOR_SIZE : bufs[i]);
+		sema_down (&c->completion_wait);
+	}
+	d->write_cnt += cnt;
 	lock_release (&c->lock);
 }
 
@@ -402,17 +471,17 @@ print_ata_string (char *string, size_t size) {
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT to the disk's sector selection
+   registers.  (We use LBA mode.)  A count of 0 means 256. */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) {
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
 
-	ASSERT (sec_no < d->capacity);
-	ASSERT (sec_no < (1UL << 28));
+	ASSERT (sec_no + cnt <= d->capacity);
+	ASSERT (sec_no + cnt <= (1UL << 28));
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	outb (reg_nsect (c), cnt & 0xff);
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
@@ -5,6 +5,8 @@
 #include <stdio.h>
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/lapic.h"
+#include "threads/mp.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 
@@ -25,20 +27,73 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* If true, the idle thread stops the periodic tick while nothing
+   is runnable and programs a one-shot interrupt for the next timer
+   deadline instead.
+   Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* 8254 input cycles per timer tick. */
+static uint16_t pit_count;
+
+/* Tickless idle state.  IDLE_SPAN is the number of tick boundaries
+   covered by the armed one-shot, or 0 while the PIT is periodic.
+   The one-shot was loaded with IDLE_COUNT cycles, of which the
+   first IDLE_FIRST completed the tick in progress.  IDLE_LOST
+   accumulates the partial ticks dropped when the periodic tick is
+   restarted mid-period, so that they are not lost for good. */
+static unsigned idle_span;
+static uint32_t idle_count;
+static uint32_t idle_first;
+static uint32_t idle_lost;
+
+/* Local APIC timer counts per tick.  Initialized by
+   timer_lapic_calibrate(). */
+static uint32_t lapic_count;
+
 static intr_handler_func timer_interrupt;
+static intr_handler_func lapic_timer_interrupt;
+static void timer_tick (void);
+static void pit_set_periodic (void);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
-void thread_sleep(int64_t ticks);
-void thread_wakeup(int64_t ticks);
-
-struct list ready_list;
 
-struct list ready_list;
-struct list sleep_list; 
+/* Hierarchical timer wheel.
+
+   Pending timers are hashed into WHEEL_LEVELS levels of WHEEL_SIZE
+   slots each.  Level 0 has one slot per tick and holds timers that
+   expire within the next WHEEL_SIZE ticks; each higher level covers
+   WHEEL_SIZE times the span of the level below it.  Whenever the
+   level-0 index wraps, the current slot of level 1 is "cascaded",
+   i.e. its timers are redistributed into level 0, and so on upward.
+
+   Adding and cancelling a timer are O(1).  The timer interrupt only
+   touches the slot that expires on this tick, and skips even that
+   when the tick is before the cached next expiry.  A bitmap per
+   level records the nonempty slots, which is what makes computing
+   the next expiry cheap. */
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)            /* Slots per level. */
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_RANGE (1LL << (WHEEL_BITS * WHEEL_LEVELS))
+
+struct timer_wheel {
+	struct list slots[WHEEL_LEVELS][WHEEL_SIZE];
+	uint64_t bitmap[WHEEL_LEVELS];  /* Bit S set iff slot S nonempty. */
+	int64_t base;                   /* Next tick to be processed. */
+	int64_t next_expiry;            /* No timer fires before this. */
+	size_t pending;                 /* Number of armed timers. */
+};
+
+static struct timer_wheel wheel;
+
+static int64_t wheel_insert (struct timer *);
+static void wheel_unlink (struct timer *);
+static void wheel_advance (int64_t now);
+static int64_t wheel_next_expiry (void);
 
-int READY_THREADS;
-int LOAD_AVG;
 /* Sets up the 8254 Programmable Interval Timer (PIT) to
    interrupt PIT_FREQ times per second, and registers the
    corresponding interrupt. */
@@ -46,11 +101,13 @@ void
 timer_init (void) {
 	/* 8254 input frequency divided by TIMER_FREQ, rounded to
 	   nearest. */
-	uint16_t count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
+	pit_count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
+	pit_set_periodic ();
 
-	outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
-	outb (0x40, count & 0xff);
-	outb (0x40, count >> 8);
+	for (int level = 0; level < WHEEL_LEVELS; level++)
+		for (int slot = 0; slot < WHEEL_SIZE; slot++)
+			list_init (&wheel.slots[level][slot]);
+	wheel.next_expiry = INT64_MAX;
 
 	intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
@@ -80,6 +137,39 @@ timer_calibrate (void) {
 	printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
 }
 
+/* Measures how fast the local APIC timer counts, against the
+   8254, and registers its interrupt.  Only the boot CPU receives
+   the 8254's ticks, so the other CPUs use their local APIC timers
+   to drive preemption; see timer_lapic_start(). */
+void
+timer_lapic_calibrate (void) {
+	int64_t start;
+
+	ASSERT (intr_get_level () == INTR_ON);
+
+	/* Count down, masked, for exactly one tick. */
+	start = ticks;
+	while (ticks == start)
+		barrier ();
+	lapic_timer_start (LAPIC_VEC_TIMER, UINT32_MAX, false, true);
+	start = ticks;
+	while (ticks == start)
+		barrier ();
+	lapic_count = UINT32_MAX - lapic_timer_current ();
+	lapic_timer_start (LAPIC_VEC_TIMER, 0, false, true);
+
+	intr_register_ext (LAPIC_VEC_TIMER, lapic_timer_interrupt,
+			"Local APIC Timer");
+}
+
+/* Starts the running CPU's local APIC timer ticking TIMER_FREQ
+   times per second.  Called on each CPU but the boot CPU. */
+void
+timer_lapic_start (void) {
+	ASSERT (lapic_count != 0);
+	lapic_timer_start (LAPIC_VEC_TIMER, lapic_count, true, false);
+}
+
 /* Returns the number of timer ticks since the OS booted. */
 int64_t
 timer_ticks (void) {
@@ -103,11 +193,9 @@ timer_sleep (int64_t ticks) {
 	int64_t start = timer_ticks ();
 
 	ASSERT (intr_get_level () == INTR_ON);
-	
-	if(timer_elapsed(start) < ticks) thread_sleep(start+ticks); // challenge : value of 'start' may become invalid at here.. how to fix it?
-	
-	// while (timer_elapsed (start) < ticks)
-	// 	thread_yield ();
+
+	if (ticks > 0)
+		thread_sleep (start + ticks);
 }
 
 /* Suspends execution for approximately MS milliseconds. */
@@ -134,55 +222,361 @@ timer_print_stats (void) {
 	printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
+/* Initializes timer T to call FUNC (AUX) when it fires. */
 void
-update_recent_cpu(void){
-	struct list_elem *e;
-	struct thread *thrd;
-	int decay_factor = div_x_by_y(mul_x_by_n(LOAD_AVG,2),add_x_and_n(mul_x_by_n(LOAD_AVG,2), 1));
-	// RUNNING THREAD도 업데이트 해야함
-	thread_current()->recent_cpu = add_x_and_n(mul_x_by_y(decay_factor,thread_current()->recent_cpu),thread_current()->nice);
-
-	for (e = list_begin (&ready_list); e != list_end (&ready_list); e = list_next (e)){
-		thrd = list_entry(e,struct thread,elem);
-		thrd->recent_cpu = add_x_and_n(mul_x_by_y(decay_factor,thrd->recent_cpu),thrd->nice);
+timer_setup (struct timer *t, timer_func *func, void *aux) {
+	ASSERT (t != NULL);
+	ASSERT (func != NULL);
+
+	t->func = func;
+	t->aux = aux;
+	t->pending = false;
+}
+
+/* Arms timer T to fire at tick EXPIRES.  If T is already pending,
+   it is rearmed.  A deadline that has already passed fires on the
+   next timer tick.  May be called from an interrupt handler. */
+void
+timer_add (struct timer *t, int64_t expires) {
+	enum intr_level old_level = intr_disable ();
+	int64_t due;
+
+	if (t->pending)
+		wheel_unlink (t);
+	t->expires = expires;
+	due = wheel_insert (t);
+	if (due < wheel.next_expiry)
+		wheel.next_expiry = due;
+	intr_set_level (old_level);
+}
+
+/* Disarms timer T.  Returns true if T was pending, false if it had
+   already fired or was never armed. */
+bool
+timer_cancel (struct timer *t) {
+	enum intr_level old_level = intr_disable ();
+	bool was_pending = t->pending;
+
+	if (was_pending)
+		wheel_unlink (t);
+	intr_set_level (old_level);
+	return was_pending;
+}
+
+/* Returns true if timer T is armed and has not yet fired. */
+bool
+timer_pending (const struct timer *t) {
+	return t->pending;
+}
+
+/* Returns the earliest tick at which the timer wheel has work to
+   do, or INT64_MAX if no timer is pending.  The result may be
+   earlier than the first real expiry, when a higher wheel level
+   must be cascaded first, but never later. */
+int64_t
+timer_next_expiry (void) {
+	enum intr_level old_level = intr_disable ();
+	int64_t next = wheel.next_expiry;
+	intr_set_level (old_level);
+	return next;
+}
+
+/* Places T in the wheel slot that matches its distance from the
+   wheel's base tick.  Returns the tick at which the wheel must next
+   look at T: its expiry if it landed in level 0, otherwise the tick
+   at which its slot is cascaded. */
+static int64_t
+wheel_insert (struct timer *t) {
+	int64_t expires = t->expires;
+	int64_t delta = expires - wheel.base;
+	int level;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (delta < 0) {
+		/* Already due: fire on the next processed tick. */
+		expires = wheel.base;
+		delta = 0;
+	} else if (delta >= WHEEL_RANGE) {
+		/* Beyond the wheel: park in the top level's farthest slot,
+		   to be re-filed when that slot is cascaded. */
+		expires = wheel.base + WHEEL_RANGE - 1;
+		delta = WHEEL_RANGE - 1;
+	}
+
+	for (level = 0; level < WHEEL_LEVELS - 1; level++)
+		if (delta < 1LL << (WHEEL_BITS * (level + 1)))
+			break;
+
+	t->level = level;
+	t->slot = (expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+	list_push_back (&wheel.slots[t->level][t->slot], &t->elem);
+	wheel.bitmap[t->level] |= 1ULL << t->slot;
+	wheel.pending++;
+	t->pending = true;
+
+	return (expires >> (WHEEL_BITS * level)) << (WHEEL_BITS * level);
+}
+
+/* Removes pending timer T from its wheel slot. */
+static void
+wheel_unlink (struct timer *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (t->pending);
+
+	list_remove (&t->elem);
+	if (list_empty (&wheel.slots[t->level][t->slot]))
+		wheel.bitmap[t->level] &= ~(1ULL << t->slot);
+	wheel.pending--;
+	t->pending = false;
+}
+
+/* Re-files every timer in SLOT of LEVEL into lower levels. */
+static void
+wheel_cascade (int level, int slot) {
+	struct list *list = &wheel.slots[level][slot];
+	struct list cascading;
+
+	/* Detach the slot first, so that a timer parked here beyond the
+	   wheel's range lands back in this slot without looping. */
+	list_init (&cascading);
+	list_splice (list_begin (&cascading), list_begin (list), list_end (list));
+	wheel.bitmap[level] &= ~(1ULL << slot);
+
+	while (!list_empty (&cascading)) {
+		struct timer *t = list_entry (list_pop_front (&cascading),
+				struct timer, elem);
+		wheel.pending--;
+		wheel_insert (t);
 	}
-	for (e=list_begin(&sleep_list); e != list_end(&sleep_list); e = list_next(e)){
-		thrd = list_entry(e,struct thread,elem);
-		thrd->recent_cpu = add_x_and_n(mul_x_by_y(decay_factor,thrd->recent_cpu),thrd->nice);
+}
+
+/* Fires every timer in the level-0 slot for the current base tick. */
+static void
+wheel_run_slot (int slot) {
+	struct list *list = &wheel.slots[0][slot];
+	struct list expired;
+
+	/* Detach the slot first: a callback may rearm its timer for a
+	   tick that maps to this same slot. */
+	list_init (&expired);
+	list_splice (list_begin (&expired), list_begin (list), list_end (list));
+	wheel.bitmap[0] &= ~(1ULL << slot);
+
+	while (!list_empty (&expired)) {
+		struct timer *t = list_entry (list_pop_front (&expired),
+				struct timer, elem);
+		wheel.pending--;
+		t->pending = false;
+		t->func (t->aux);
 	}
 }
 
+/* Processes the wheel up to and including tick NOW. */
+static void
+wheel_advance (int64_t now) {
+	ASSERT (intr_get_level () == INTR_OFF);
 
-void
-recompute_priority(void){
-	struct list_elem *e;
-	struct thread *thrd;
-	thread_current()->priority = convert_x_to_int_round_to_nearest(sub_n_from_x(sub_y_from_x(convert_n_to_fp(PRI_MAX),(div_x_by_n(thread_current()->recent_cpu,4))),(2 * thread_current()->nice)));
-	for (e = list_begin (&ready_list); e != list_end (&ready_list); e = list_next (e)){
-		thrd = list_entry(e,struct thread,elem);
-		thrd->priority = convert_x_to_int_round_to_nearest(sub_n_from_x(sub_y_from_x(convert_n_to_fp(PRI_MAX),(div_x_by_n(thrd->recent_cpu,4))),(2 * thrd->nice)));
-		if (PRI_MAX < thrd->priority) thrd->priority = PRI_MAX;
-		else if (PRI_MIN > thrd->priority) thrd->priority = PRI_MIN;
+	/* Common case: nothing can fire or cascade yet. */
+	if (now < wheel.next_expiry) {
+		wheel.base = now + 1;
+		return;
 	}
-	for (e=list_begin(&sleep_list); e != list_end(&sleep_list); e = list_next(e)){
-		thrd = list_entry(e,struct thread,elem);
-		// recent_cpu를 fp로 바꿀까?
-		thrd->priority = convert_x_to_int_round_to_nearest(sub_n_from_x(sub_y_from_x(convert_n_to_fp(PRI_MAX),(div_x_by_n(thrd->recent_cpu,4))),(2 * thrd->nice)));
-		if (PRI_MAX < thrd->priority) thrd->priority = PRI_MAX;
-		else if (PRI_MIN > thrd->priority) thrd->priority = PRI_MIN;
+
+	while (wheel.base <= now) {
+		int slot = wheel.base & WHEEL_MASK;
+		int level;
+
+		/* On each wrap of a level's index, cascade the next level's
+		   current slot down. */
+		for (level = 1; level < WHEEL_LEVELS; level++) {
+			int64_t shift = wheel.base >> (WHEEL_BITS * (level - 1));
+			if ((shift & WHEEL_MASK) != 0)
+				break;
+			wheel_cascade (level, (shift >> WHEEL_BITS) & WHEEL_MASK);
+		}
+
+		if (wheel.bitmap[0] & (1ULL << slot))
+			wheel_run_slot (slot);
+		wheel.base++;
 	}
+	wheel.next_expiry = wheel_next_expiry ();
 }
+
+/* Rotates X right by N bits, 0 <= N < 64. */
+static inline uint64_t
+rotr64 (uint64_t x, int n) {
+	return n == 0 ? x : (x >> n) | (x << (64 - n));
+}
+
+/* Computes the earliest tick at which the wheel has work: the first
+   nonempty level-0 slot, or the first cascade of a nonempty slot of
+   a higher level, whichever comes first. */
+static int64_t
+wheel_next_expiry (void) {
+	int64_t next = INT64_MAX;
+	int level;
+
+	if (wheel.pending == 0)
+		return next;
+
+	if (wheel.bitmap[0] != 0) {
+		int idx = wheel.base & WHEEL_MASK;
+		next = wheel.base + __builtin_ctzll (rotr64 (wheel.bitmap[0], idx));
+	}
+
+	for (level = 1; level < WHEEL_LEVELS; level++) {
+		int shift = WHEEL_BITS * level;
+		int64_t window, cascade;
+
+		if (wheel.bitmap[level] == 0)
+			continue;
+
+		/* Slot S of this level is cascaded at the first tick, not
+		   before BASE, that starts a window congruent to S. */
+		window = (wheel.base + (1LL << shift) - 1) >> shift;
+		cascade = window + __builtin_ctzll (rotr64 (wheel.bitmap[level],
+					window & WHEEL_MASK));
+		cascade <<= shift;
+		if (cascade < next)
+			next = cascade;
+	}
+	return next;
+}
+
+/* Programs the 8254 to interrupt every PIT_COUNT cycles. */
+static void
+pit_set_periodic (void) {
+	outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
+	outb (0x40, pit_count & 0xff);
+	outb (0x40, pit_count >> 8);
+}
+
+/* Programs the 8254 to interrupt once, COUNT cycles from now. */
+static void
+pit_set_oneshot (uint16_t count) {
+	outb (0x43, 0x30);    /* CW: counter 0, LSB then MSB, mode 0, binary. */
+	outb (0x40, count & 0xff);
+	outb (0x40, count >> 8);
+}
+
+/* Returns the current value of the 8254's counter 0. */
+static uint16_t
+pit_read_count (void) {
+	uint8_t lsb, msb;
+
+	outb (0x43, 0x00);    /* Latch counter 0. */
+	lsb = inb (0x40);
+	msb = inb (0x40);
+	return lsb | (msb << 8);
+}
+
+/* Returns true if counter 0 has reached its terminal count since
+   it was last programmed in mode 0. */
+static bool
+pit_expired (void) {
+	outb (0x43, 0xe2);    /* Read-back: status only, counter 0. */
+	return (inb (0x40) & 0x80) != 0;
+}
+
+/* Called by the idle thread, with interrupts off, just before it
+   halts.  In tickless mode, replaces the periodic tick by a single
+   interrupt at the tick boundary of the next timer deadline.  The
+   8254's 16-bit counter bounds the one-shot to a few ticks, after
+   which the idle thread simply comes back here. */
+void
+timer_idle_enter (void) {
+	unsigned max_ticks = (UINT16_MAX - pit_count) / pit_count + 1;
+	int64_t delta;
+	unsigned n;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	/* The 8254 only ticks for the boot CPU. */
+	if (!timer_tickless || idle_span != 0 || cpu_current ()->id != 0)
+		return;
+
+	/* The periodic tick would next fire at boundary TICKS + 1. */
+	delta = wheel.next_expiry - ticks;
+	if (delta <= 1)
+		return;
+	n = delta < max_ticks ? delta : max_ticks;
+	if (n <= 1)
+		return;
+
+	/* Keep the tick phase: expire exactly where the N'th periodic
+	   interrupt would have. */
+	idle_first = pit_read_count ();
+	idle_count = idle_first + (n - 1) * pit_count;
+	idle_span = n;
+	pit_set_oneshot (idle_count);
+}
+
+/* Called at the start of every external interrupt.  If the CPU was
+   idling without a periodic tick, accounts for the ticks that went
+   by, as if each had interrupted the idle thread, and restores the
+   periodic tick. */
+void
+timer_idle_exit (void) {
+	unsigned skipped;
+
+	ASSERT (intr_context ());
+
+	if (idle_span == 0 || cpu_current ()->id != 0)
+		return;
+
+	if (pit_expired ()) {
+		/* The one-shot's own interrupt accounts for the last
+		   tick. */
+		skipped = idle_span - 1;
+	} else {
+		/* Woken early by another device.  Restarting the periodic
+		   tick here drops the part of the current tick that already
+		   went by; carry it in IDLE_LOST. */
+		uint32_t since = (pit_count - idle_first)
+			+ (idle_count - pit_read_count ());
+		skipped = since / pit_count;
+		idle_lost += since % pit_count;
+		if (idle_lost >= pit_count) {
+			idle_lost -= pit_count;
+			skipped++;
+		}
+	}
+	idle_span = 0;
+	pit_set_periodic ();
+
+	while (skipped-- > 0)
+		timer_tick ();
+}
+
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED) {
+	timer_tick ();
+}
+
+/* Local APIC timer handler, on every CPU but the boot CPU.  Keeps
+   the global clock to the 8254 but does the running thread's
+   per-tick accounting. */
+static void
+lapic_timer_interrupt (struct intr_frame *args UNUSED) {
+	struct cpu *c = cpu_current ();
+
+	c->ticks++;
+	thread_tick ();
+	if (thread_mlfqs) {
+		thread_current ()->recent_cpu += 16384;
+		if (c->ticks % 4 == 0)
+			thread_mlfqs_recompute_priority ();
+	}
+}
+
+/* Advances the clock by one tick and does the per-tick work. */
+static void
+timer_tick (void) {
 	ticks++;
 	thread_tick ();
-	thread_wakeup(ticks);
-	/* check sleep list and the global tick.
-	   find any threads to wake up,
-	   move them to the ready list if necessary.
-	   update the global tick.
-	*/
+	wheel_advance (ticks);
 	if(thread_mlfqs){
 	enum intr_level old_level = intr_disable ();
 	thread_current()->recent_cpu += 16384; // for every tick 
@@ -192,18 +586,16 @@ timer_interrupt (struct intr_frame *args UNUSED) {
 	
 	
 		int decayed_load_avg = div_x_by_n(mul_x_by_n(LOAD_AVG,59),60);
-		READY_THREADS = list_size(&ready_list);
-		if(thread_current() != idle_thread)  // idle이 아니라면, +1 , 맞으면 그냥 
-			READY_THREADS += 1;
+		READY_THREADS = thread_ready_count () + thread_running_count (); // idle이 아닌 실행 중인 스레드 포함
 
 		int fp_ready_thread = convert_n_to_fp(READY_THREADS);
 		int decayed_ready_threads = div_x_by_n(fp_ready_thread,60);
 		LOAD_AVG = add_x_and_y(decayed_load_avg,decayed_ready_threads); // update load average in every sec
 
-		update_recent_cpu();
+		thread_mlfqs_update_recent_cpu ();
 	}
 	if ( timer_ticks() % 4 == 0){ // 4틱 마다
-		recompute_priority();
+		thread_mlfqs_recompute_priority ();
 		// recompute the priority of all threads
 	}
 	intr_set_level (old_level);
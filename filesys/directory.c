@@ -5,6 +5,7 @@
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir {
@@ -71,6 +72,11 @@ dir_get_inode (struct dir *dir) {
 	return dir->inode;
 }
 
+/* Each directory's entries are guarded by the rwlock of its
+ * inode, which dir_lookup() and dir_readdir() take for reading and
+ * dir_add() and dir_remove() for writing.  A directory lock is
+ * always taken before the open inode list's lock in inode.c. */
+
 /* Searches DIR for a file with the given NAME.
  * If successful, returns true, sets *EP to the directory entry
  * if EP is non-null, and sets *OFSP to the byte offset of the
@@ -109,10 +115,12 @@ dir_lookup (const struct dir *dir, const char *name,
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	rwlock_read_acquire (inode_dir_lock (dir->inode));
 	if (lookup (dir, name, &e, NULL))
 		*inode = inode_open (e.inode_sector);
 	else
 		*inode = NULL;
+	rwlock_read_release (inode_dir_lock (dir->inode));
 
 	return *inode != NULL;
 }
@@ -137,6 +145,7 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 		return false;
 
 	/* Check that NAME is not in use. */
+	rwlock_write_acquire (inode_dir_lock (dir->inode));
 	if (lookup (dir, name, NULL, NULL))
 		goto done;
 
@@ -159,6 +168,7 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
 done:
+	rwlock_write_release (inode_dir_lock (dir->inode));
 	return success;
 }
 
@@ -176,6 +186,7 @@ dir_remove (struct dir *dir, const char *name) {
 	ASSERT (name != NULL);
 
 	/* Find directory entry. */
+	rwlock_write_acquire (inode_dir_lock (dir->inode));
 	if (!lookup (dir, name, &e, &ofs))
 		goto done;
 
@@ -194,6 +205,7 @@ dir_remove (struct dir *dir, const char *name) {
 	success = true;
 
 done:
+	rwlock_write_release (inode_dir_lock (dir->inode));
 	inode_close (inode);
 	return success;
 }
@@ -204,13 +216,17 @@ done:
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
 	struct dir_entry e;
+	bool found = false;
 
+	rwlock_read_acquire (inode_dir_lock (dir->inode));
 	while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
 		dir->pos += sizeof e;
 		if (e.in_use) {
 			strlcpy (name, e.name, NAME_MAX + 1);
-			return true;
+			found = true;
+			break;
 		}
 	}
-	return false;
+	rwlock_read_release (inode_dir_lock (dir->inode));
+	return found;
 }
@@ -1,7 +1,7 @@
 #include "filesys/file.h"
 #include <debug.h>
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
 
 /* An open file. */
 struct file 
@@ -11,6 +11,17 @@ struct file
 	bool deny_write;            /* Has file_deny_write() been called? */
 };
 
+/* Allocates open files. */
+static struct kmem_cache *file_cache;
+
+/* Initializes the file module. */
+void
+file_init (void) {
+	file_cache = kmem_cache_create ("file", sizeof (struct file), 0, NULL);
+	if (file_cache == NULL)
+		PANIC ("file_init: out of memory");
+}
+
 /* Opens a file for the given INODE, of which it takes ownership,
  * and returns the new file.  Returns a null pointer if an
  * allocation fails or if INODE is null. */
@@ -21,7 +32,7 @@ struct file
 struct file *
 file_open (struct inode *inode) 
 {
-	struct file *file = calloc (1, sizeof *file); // 파일 구조체를 위한 메모리를 할당하고 0으로 초기화합니다.
+	struct file *file = kmem_cache_alloc (file_cache); // 파일 구조체를 위한 메모리를 할당합니다.
 	if (inode != NULL && file != NULL) { // inode와 파일 구조체 할당이 성공했는지 확인합니다.
 		file->inode = inode; // 파일 구조체에 inode를 설정합니다.
 		file->pos = 0; // 파일 내 위치를 0으로 설정합니다 (파일의 시작점).
@@ -29,7 +40,7 @@ file_open (struct inode *inode)
 		return file; // 초기화된 파일 구조체를 반환합니다.
 	} else {
 		inode_close (inode); // inode가 NULL이 아니면 inode를 닫습니다.
-		free (file); // 파일 구조체에 대한 메모리 할당을 해제합니다.
+		kmem_cache_free (file_cache, file); // 파일 구조체에 대한 메모리 할당을 해제합니다.
 		return NULL; // 실패 시 NULL을 반환합니다.
 	}
 }
@@ -64,7 +75,7 @@ file_close (struct file *file)
 	if (file != NULL) {
 		file_allow_write (file);
 		inode_close (file->inode);
-		free (file);
+		kmem_cache_free (file_cache, file);
 	}
 }
 
@@ -6,6 +6,8 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -33,6 +35,7 @@ struct inode {
 	int open_cnt;                       /* Number of openers. */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+	struct rwlock dir_lock;             /* Entries, if a directory. */
 	struct inode_disk data;             /* Inode content. */
 };
 
@@ -50,13 +53,35 @@ byte_to_sector (const struct inode *inode, off_t pos) {
 }
 
 /* List of open inodes, so that opening a single inode twice
- * returns the same `struct inode'. */
+ * returns the same `struct inode'.  Most opens find the inode
+ * already there, so lookups share OPEN_INODES_LOCK and only
+ * inserting and removing take it for writing. */
 static struct list open_inodes;
+static struct rwlock open_inodes_lock;
+
+/* Allocates in-memory inodes. */
+static struct kmem_cache *inode_cache;
+
+/* Constructs a cached inode.  Its lock stays initialized across
+ * uses, since an inode is only freed once nobody holds it. */
+static void
+inode_ctor (void *obj) {
+	struct inode *inode = obj;
+
+	rwlock_init (&inode->dir_lock);
+}
+
+static struct inode *find_open_inode (disk_sector_t);
 
 /* Initializes the inode module. */
 void
 inode_init (void) {
 	list_init (&open_inodes);
+	rwlock_init (&open_inodes_lock);
+	inode_cache = kmem_cache_create ("inode", sizeof (struct inode), 0,
+			inode_ctor);
+	if (inode_cache == NULL)
+		PANIC ("inode_init: out of memory");
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -101,39 +126,62 @@ inode_create (disk_sector_t sector, off_t length) {
  * Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (disk_sector_t sector) {
-	struct list_elem *e;
 	struct inode *inode;
+	struct inode *open;
 
 	/* Check whether this inode is already open. */
-	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-			e = list_next (e)) {
-		inode = list_entry (e, struct inode, elem);
-		if (inode->sector == sector) {
-			inode_reopen (inode);
-			return inode; 
-		}
-	}
+	rwlock_read_acquire (&open_inodes_lock);
+	open = inode_reopen (find_open_inode (sector));
+	rwlock_read_release (&open_inodes_lock);
+	if (open != NULL)
+		return open;
 
 	/* Allocate memory. */
-	inode = malloc (sizeof *inode);
+	inode = kmem_cache_alloc (inode_cache);
 	if (inode == NULL)
 		return NULL;
 
-	/* Initialize. */
-	list_push_front (&open_inodes, &inode->elem);
+	/* Initialize.  Read the disk before publishing the inode, so
+	 * that nobody else can find it half-read. */
 	inode->sector = sector;
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
 	disk_read (filesys_disk, inode->sector, &inode->data);
+
+	/* Someone else may have opened it meanwhile. */
+	rwlock_write_acquire (&open_inodes_lock);
+	open = inode_reopen (find_open_inode (sector));
+	if (open == NULL)
+		list_push_front (&open_inodes, &inode->elem);
+	rwlock_write_release (&open_inodes_lock);
+	if (open != NULL) {
+		kmem_cache_free (inode_cache, inode);
+		return open;
+	}
 	return inode;
 }
 
+/* Returns the open inode for SECTOR, or a null pointer if there
+ * is none.  OPEN_INODES_LOCK must be held. */
+static struct inode *
+find_open_inode (disk_sector_t sector) {
+	struct list_elem *e;
+
+	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
+			e = list_next (e)) {
+		struct inode *inode = list_entry (e, struct inode, elem);
+		if (inode->sector == sector)
+			return inode;
+	}
+	return NULL;
+}
+
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode) {
 	if (inode != NULL)
-		inode->open_cnt++;
+		__atomic_fetch_add (&inode->open_cnt, 1, __ATOMIC_RELAXED);
 	return inode;
 }
 
@@ -152,10 +200,23 @@ inode_close (struct inode *inode) {
 	if (inode == NULL)
 		return;
 
-	/* Release resources if this was the last opener. */
-	if (--inode->open_cnt == 0) {
-		/* Remove from inode list and release lock. */
+	/* Drop a reference that is not the last one without the lock.
+	 * The last one must be dropped under OPEN_INODES_LOCK, so that
+	 * inode_open() cannot find the inode as it goes away. */
+	int cnt = __atomic_load_n (&inode->open_cnt, __ATOMIC_RELAXED);
+	while (cnt > 1)
+		if (__atomic_compare_exchange_n (&inode->open_cnt, &cnt, cnt - 1,
+					false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			return;
+
+	rwlock_write_acquire (&open_inodes_lock);
+	cnt = __atomic_sub_fetch (&inode->open_cnt, 1, __ATOMIC_ACQ_REL);
+	if (cnt == 0)
 		list_remove (&inode->elem);
+	rwlock_write_release (&open_inodes_lock);
+
+	/* Release resources if this was the last opener. */
+	if (cnt == 0) {
 
 		/* Deallocate blocks if removed. */
 		if (inode->removed) {
@@ -164,10 +225,17 @@ inode_close (struct inode *inode) {
 					bytes_to_sectors (inode->data.length)); 
 		}
 
-		free (inode); 
+		kmem_cache_free (inode_cache, inode);
 	}
 }
 
+/* Returns the lock that guards INODE's entries when INODE is a
+ * directory.  See directory.c. */
+struct rwlock *
+inode_dir_lock (struct inode *inode) {
+	return &inode->dir_lock;
+}
+
 /* Marks INODE to be deleted when it is closed by the last caller who
  * has it open. */
 void
@@ -1,7 +1,9 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
@@ -9,6 +11,8 @@
 
 void timer_init (void);
 void timer_calibrate (void);
+void timer_lapic_calibrate (void);
+void timer_lapic_start (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
@@ -20,4 +24,33 @@ void timer_nsleep (int64_t nanoseconds);
 
 void timer_print_stats (void);
 
+/* If true, stop the periodic tick while the CPU is idle.
+   Controlled by kernel command-line option "-tickless". */
+extern bool timer_tickless;
+
+void timer_idle_enter (void);
+void timer_idle_exit (void);
+
+/* Kernel timer.  Once armed with timer_add(), FUNC (AUX) is called
+   from the timer interrupt, with interrupts off, at the first tick
+   at or after EXPIRES.  A timer is embedded in the object that owns
+   it, so arming it never allocates memory. */
+typedef void timer_func (void *aux);
+
+struct timer {
+	int64_t expires;            /* Tick at which FUNC runs. */
+	timer_func *func;           /* Callback. */
+	void *aux;                  /* Argument to FUNC. */
+	struct list_elem elem;      /* Element in a timer wheel slot. */
+	uint8_t level;              /* Wheel level while pending. */
+	uint8_t slot;               /* Wheel slot while pending. */
+	bool pending;               /* Armed and not yet fired? */
+};
+
+void timer_setup (struct timer *, timer_func *, void *aux);
+void timer_add (struct timer *, int64_t expires);
+bool timer_cancel (struct timer *);
+bool timer_pending (const struct timer *);
+int64_t timer_next_expiry (void);
+
 #endif /* devices/timer.h */
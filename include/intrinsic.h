@@ -119,6 +119,18 @@ static __inline uint64_t rcr2(void) {
 	return val;
 }
 
+__attribute__((always_inline))
+static __inline uint64_t rcr4(void) {
+	uint64_t val;
+	__asm __volatile("movq %%cr4,%0" : "=r" (val));
+	return val;
+}
+
+__attribute__((always_inline))
+static __inline void lcr4(uint64_t val) {
+	__asm __volatile("movq %0, %%cr4" : : "r" (val));
+}
+
 __attribute__((always_inline))
 static __inline void write_msr(uint32_t ecx, uint64_t val) {
 	uint32_t edx, eax;
@@ -128,4 +140,13 @@ static __inline void write_msr(uint32_t ecx, uint64_t val) {
 			:: "c" (ecx), "d" (edx), "a" (eax) );
 }
 
+/* Reads the time-stamp counter.  See [IA32-v2b] "RDTSC--Read
+   Time-Stamp Counter". */
+__attribute__((always_inline))
+static __inline uint64_t rdtsc(void) {
+	uint32_t edx, eax;
+	__asm __volatile("rdtsc" : "=d" (edx), "=a" (eax));
+	return ((uint64_t) edx << 32) | eax;
+}
+
 #endif /* intrinsic.h */
@@ -0,0 +1,42 @@
+#ifndef THREADS_KSTACK_H
+#define THREADS_KSTACK_H
+
+/* Kernel stacks.
+
+   A kernel stack is a block of KSTACK_PAGES pages aligned to its
+   own size, KSTACK_SIZE.  The lowest page is a guard page that is
+   never mapped, so running off the bottom of the stack faults
+   instead of overwriting whatever lies below.  The last word of
+   the block points to the thread that owns the stack, which is
+   how running_thread() finds the running thread from the stack
+   pointer alone.  The stack proper grows down from KSTACK_TOP.
+
+   KSTACK_PAGES may be changed at build time, to any power of 2
+   that is at least 2. */
+#define KSTACK_PAGES 4
+#define KSTACK_SIZE (KSTACK_PAGES << 12)
+
+#ifndef __ASSEMBLER__
+#include <stdbool.h>
+#include <stdint.h>
+
+struct thread;
+
+/* Returns the owner slot of the kernel stack that contains ADDR. */
+static inline struct thread **
+kstack_owner (uint64_t addr) {
+	return (struct thread **) ((addr & ~(uint64_t) (KSTACK_SIZE - 1))
+			+ KSTACK_SIZE - sizeof (struct thread *));
+}
+
+/* Returns the initial stack pointer of kernel stack STACK: just
+   below the owner slot, 16-byte aligned. */
+#define KSTACK_TOP(STACK) ((uint64_t) (STACK) + KSTACK_SIZE - 16)
+
+void kstack_init (void);
+void *kstack_alloc (void);
+void kstack_free (void *);
+bool kstack_in_guard (const void *stack, const void *addr);
+#endif
+
+#endif /* threads/kstack.h */
@@ -0,0 +1,23 @@
+#ifndef THREADS_LAPIC_H
+#define THREADS_LAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Interrupt vectors delivered by the local APIC.  Vectors
+   0x20...0x2f belong to the 8259A PICs, so these follow them. */
+#define LAPIC_VEC_TIMER    0x30     /* Local timer. */
+#define LAPIC_VEC_RESCHED  0x31     /* Reschedule IPI. */
+#define LAPIC_VEC_SPURIOUS 0xff     /* Spurious interrupt. */
+
+void lapic_map (uint64_t paddr);
+bool lapic_present (void);
+void lapic_init (bool bsp);
+uint8_t lapic_id (void);
+void lapic_eoi (void);
+void lapic_send_ipi (uint8_t apic_id, uint8_t vec);
+void lapic_start_ap (uint8_t apic_id, uint64_t paddr);
+void lapic_timer_start (uint8_t vec, uint32_t count, bool periodic, bool masked);
+uint32_t lapic_timer_current (void);
+
+#endif /* threads/lapic.h */
@@ -11,6 +11,10 @@
 /* Kernel virtual address at which all physical memory is mapped. */
 #define LOADER_PHYS_BASE 0x200000
 
+/* Physical address to which application processors' startup code
+   is copied.  Must be page-aligned, below 1 MB, and unused. */
+#define MPENTRY_PADDR 0x8000
+
 /* Multiboot infos */
 #define MULTIBOOT_INFO       0x7000
 #define MULTIBOOT_FLAG       MULTIBOOT_INFO
@@ -30,17 +30,25 @@ typedef bool pte_for_each_func (uint64_t *pte, void *va, void *aux);
 bool pml4_for_each (uint64_t *, pte_for_each_func *, void *);
 
 uint64_t *pml4e_walk (uint64_t *pml4, const uint64_t va, int create);
+uint64_t *pml4_pde_walk (uint64_t *pml4, const uint64_t va, int create);
 uint64_t *pml4_create (void);
 void pml4_destroy (uint64_t *pml4);
 void pml4_activate (uint64_t *pml4);
+bool pml4_is_loaded_elsewhere (uint64_t *pml4);
+void mmu_init_cpu (void);
 void *pml4_get_page (uint64_t *pml4, const void *upage);
 bool pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
-void pml4_clear_page (uint64_t *pml4, void *upage);
+bool pml4_set_huge_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
+bool pml4_split_huge_page (uint64_t *pml4, void *upage);
+bool pml4_clear_huge_page (uint64_t *pml4, void *upage);
+bool pml4_clear_page (uint64_t *pml4, void *upage);
 bool pml4_is_dirty (uint64_t *pml4, const void *upage);
 void pml4_set_dirty (uint64_t *pml4, const void *upage, bool dirty);
 bool pml4_is_accessed (uint64_t *pml4, const void *upage);
 void pml4_set_accessed (uint64_t *pml4, const void *upage, bool accessed);
 
+extern uint64_t huge_split_cnt;
+
 // PTE가 가리키는 가상주소가 작성 가능한지 여부 확인
 #define is_writable(pte) (*(pte) & PTE_W)
 
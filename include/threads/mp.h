@@ -0,0 +1,57 @@
+#ifndef THREADS_MP_H
+#define THREADS_MP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Maximum number of CPUs the kernel will bring up. */
+#define CPU_MAX 8
+
+/* Number of address spaces each CPU keeps TLB entries for, when
+   it has PCIDs.  See threads/mmu.c. */
+#define PCID_SLOTS 6
+
+struct thread;
+struct task_state;
+
+/* Per-CPU state.
+
+   Every field is only ever touched by its own CPU, except where
+   noted.  The first three members are accessed by offset from
+   userprog/syscall-entry.S, so they must stay where they are. */
+struct cpu {
+	uint64_t syscall_scratch[2];        /* Scratch for syscall_entry. */
+	struct task_state *tss;             /* This CPU's TSS. */
+
+	int id;                             /* Index in cpus[]. */
+	uint8_t apic_id;                    /* Local APIC ID. */
+	volatile bool started;              /* Up and scheduling? */
+
+	/* Owned by thread.c; read by other CPUs under the kernel
+	   lock (see interrupt.c). */
+	struct thread *idle_thread;         /* This CPU's idle thread. */
+	struct thread *curr;                /* Running thread. */
+	unsigned thread_ticks;              /* Timer ticks since last yield. */
+
+	/* Owned by interrupt.c. */
+	bool in_external_intr;              /* Processing an external interrupt? */
+	bool yield_on_return;               /* Yield on interrupt return? */
+
+	/* Owned by devices/timer.c. */
+	int64_t ticks;                      /* Local timer ticks. */
+
+	/* Owned by threads/mmu.c. */
+	uint64_t *pml4;                     /* Loaded page table. */
+	uint64_t *pcid_pml4[PCID_SLOTS];    /* Page table given each PCID. */
+	int pcid_next;                      /* Next PCID slot to reuse. */
+};
+
+extern struct cpu cpus[CPU_MAX];
+extern int cpu_cnt;
+
+struct cpu *cpu_current (void);
+
+void mp_init (void);
+void mp_start_aps (void);
+
+#endif /* threads/mp.h */
@@ -1,6 +1,8 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <list.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
@@ -14,10 +16,32 @@ enum palloc_flags {
 /* Maximum number of pages to put in user pool. */
 extern size_t user_page_limit;
 
+/* Percentage of pages to put in user pool. */
+extern unsigned user_pool_percent;
+
+/* Let each pool borrow from the other? */
+extern bool palloc_dynamic;
+
+/* Subscriber to memory pressure on one pool.  See palloc.c. */
+struct palloc_watcher {
+	bool user;                      /* Watch user pool, not kernel pool? */
+	void (*low) (void *aux);        /* Free pages fell below low mark. */
+	void (*high) (void *aux);       /* Free pages back at high mark. */
+	void *aux;                      /* Passed to LOW and HIGH. */
+	struct list_elem elem;          /* Owned by palloc.c. */
+};
+
 uint64_t palloc_init (void);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+void palloc_start_threads (void);
+void palloc_print_stats (void);
+
+void palloc_watch (struct palloc_watcher *);
+void palloc_unwatch (struct palloc_watcher *);
+void palloc_set_watermarks (bool user, size_t low, size_t high);
+size_t palloc_free_cnt (bool user);
 
 #endif /* threads/palloc.h */
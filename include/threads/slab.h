@@ -0,0 +1,18 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+
+/* Object caches for fixed-size kernel objects.  See slab.c. */
+struct kmem_cache;
+
+typedef void kmem_ctor_func (void *obj);
+
+void kmem_init (void);
+struct kmem_cache *kmem_cache_create (const char *name, size_t size,
+		size_t align, kmem_ctor_func *ctor);
+void *kmem_cache_alloc (struct kmem_cache *) __attribute__ ((malloc));
+void kmem_cache_free (struct kmem_cache *, void *);
+void kmem_print_stats (void);
+
+#endif /* threads/slab.h */
@@ -0,0 +1,12 @@
+#ifndef THREADS_SWITCH_H
+#define THREADS_SWITCH_H
+
+#include <stdint.h>
+
+struct intr_frame;
+
+/* Defined in threads/switch.S. */
+void switch_threads (uint64_t *cur_rsp, uint64_t next_rsp);
+void switch_to_frame (uint64_t *cur_rsp, struct intr_frame *tf);
+
+#endif /* threads/switch.h */
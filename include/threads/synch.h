@@ -3,11 +3,14 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+struct thread;
 
 /* A counting semaphore. */
 struct semaphore {
-	unsigned value;             /* Current value. */
-	struct list waiters;        /* List of waiting threads. */
+	unsigned value;             /* Current value, plus a waiters flag. */
+	struct list waiters;        /* Waiting threads, by priority. */
 };
 
 struct semaphore_elem {
@@ -17,21 +20,32 @@ struct semaphore_elem {
 
 void sema_init (struct semaphore *, unsigned value);
 void sema_down (struct semaphore *);
+bool sema_down_timeout (struct semaphore *, int64_t ticks);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
+void sema_requeue (struct semaphore *, struct thread *);
 void sema_self_test (void);
 
 /* Lock. */
 struct lock {
 	struct thread *holder;      /* Thread holding lock (for debugging). */
 	struct semaphore semaphore; /* Binary semaphore controlling access. */
+	bool adaptive;              /* Spin before blocking? */
+	struct list_elem elem;      /* Element in holder's held_locks. */
 };
 
+/* Farthest that a priority donation is passed down a chain of
+   threads each waiting on a lock the next one holds. */
+#define DONATE_DEPTH_MAX 8
+
 void lock_init (struct lock *);
+void lock_set_adaptive (struct lock *, bool);
 void lock_acquire (struct lock *);
+bool lock_acquire_timeout (struct lock *, int64_t ticks);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+int lock_donated_priority (struct thread *);
 
 /* Condition variable. */
 struct condition {
@@ -40,9 +54,47 @@ struct condition {
 
 void cond_init (struct condition *);
 void cond_wait (struct condition *, struct lock *);
+bool cond_wait_timeout (struct condition *, struct lock *, int64_t ticks);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Reader-writer lock. */
+struct rwlock {
+	struct thread *writer;      /* Writer holding the lock, if any. */
+	struct list holders;        /* Holders' struct rw_hold's. */
+	struct list read_waiters;   /* Waiting readers, by priority. */
+	struct list write_waiters;  /* Waiting writers, by priority. */
+};
+
+/* One thread's hold on an rwlock.  Kept in the thread, which has
+   RW_HOLD_MAX of them. */
+struct rw_hold {
+	struct rwlock *lock;        /* Lock held, or NULL if unused. */
+	struct thread *thread;      /* Holding thread. */
+	struct list_elem elem;      /* Element in LOCK's holders. */
+};
+
+#define RW_HOLD_MAX 4           /* Rwlocks a thread may hold at once. */
+
+void rwlock_init (struct rwlock *);
+void rwlock_read_acquire (struct rwlock *);
+void rwlock_read_release (struct rwlock *);
+void rwlock_write_acquire (struct rwlock *);
+void rwlock_write_release (struct rwlock *);
+bool rwlock_held_by_current_thread (const struct rwlock *);
+
+/* Spin lock.  Excludes other CPUs only; the holder must keep
+   interrupts off for as long as it holds the lock. */
+struct spinlock {
+	volatile int locked;        /* Nonzero while held. */
+	struct cpu *holder;         /* CPU holding lock (for debugging). */
+};
+
+void spin_init (struct spinlock *);
+void spin_lock (struct spinlock *);
+void spin_unlock (struct spinlock *);
+bool spin_held (const struct spinlock *);
+
 /* Optimization barrier.
  *
  * The compiler will not reorder operations across an
@@ -5,10 +5,13 @@
 #include <list.h>
 #include <stdint.h>
 #include "threads/interrupt.h"
+#include "threads/synch.h"
 #ifdef VM
 #include "vm/vm.h"
 #endif
 
+struct cpu;
+
 
 /* States in a thread's life cycle. */
 enum thread_status {
@@ -55,13 +58,15 @@ typedef int tid_t;
 
 /* A kernel thread or user process.
  *
- * Each thread structure is stored in its own 4 kB page.  The
- * thread structure itself sits at the very bottom of the page
- * (at offset 0).  The rest of the page is reserved for the
- * thread's kernel stack, which grows downward from the top of
- * the page (at offset 4 kB).  Here's an illustration:
+ * Each thread structure is stored in its own 4 kB page, apart
+ * from the thread's kernel stack, which is a block of
+ * KSTACK_PAGES pages from threads/kstack.c.  The lowest page of
+ * the block is a guard page that is never mapped, and the block's
+ * last word points back to the thread structure.  Here's an
+ * illustration, for the default of 4 pages:
  *
- *      4 kB +---------------------------------+
+ *     16 kB +---------------------------------+
+ *           |        owner (struct thread *)  |
  *           |          kernel stack           |
  *           |                |                |
  *           |                |                |
@@ -69,41 +74,25 @@ typedef int tid_t;
  *           |         grows downward          |
  *           |                                 |
  *           |                                 |
- *           |                                 |
- *           |                                 |
- *           |                                 |
- *           |                                 |
- *           |                                 |
- *           |                                 |
- *           +---------------------------------+
- *           |              magic              |
- *           |            intr_frame           |
- *           |                :                |
- *           |                :                |
- *           |               name              |
- *           |              status             |
+ *      4 kB +---------------------------------+
+ *           |     guard page (not mapped)     |
  *      0 kB +---------------------------------+
  *
  * The upshot of this is twofold:
  *
- *    1. First, `struct thread' must not be allowed to grow too
- *       big.  If it does, then there will not be enough room for
- *       the kernel stack.  Our base `struct thread' is only a
- *       few bytes in size.  It probably should stay well under 1
- *       kB.
+ *    1. First, `struct thread' may grow to nearly a page without
+ *       taking any room from the kernel stack.
  *
- *    2. Second, kernel stacks must not be allowed to grow too
- *       large.  If a stack overflows, it will corrupt the thread
- *       state.  Thus, kernel functions should not allocate large
- *       structures or arrays as non-static local variables.  Use
- *       dynamic allocation with malloc() or palloc_get_page()
+ *    2. Second, a kernel stack that overflows runs into its guard
+ *       page and page faults, rather than silently corrupting the
+ *       thread state.  Kernel functions still should not allocate
+ *       large structures or arrays as non-static local variables.
+ *       Use dynamic allocation with malloc() or palloc_get_page()
  *       instead.
  *
- * The first symptom of either of these problems will probably be
- * an assertion failure in thread_current(), which checks that
- * the `magic' member of the running thread's `struct thread' is
- * set to THREAD_MAGIC.  Stack overflow will normally change this
- * value, triggering the assertion. */
+ * The `magic' member of `struct thread' is still checked by
+ * thread_current(), to catch stray pointers and writes that skip
+ * over the guard page. */
 /* The `elem' member has a dual purpose.  It can be an element in
  * the run queue (thread.c), or it can be an element in a
  * semaphore wait list (synch.c).  It can be used these two ways
@@ -116,18 +105,25 @@ struct thread {
 	enum thread_status status;          /* Thread state. */
 	char name[16];                      /* Name (for debugging purposes). */
 	int priority;                       /* Priority. */
+	int rq_priority;                    /* Run queue level while ready. */
+	struct cpu *cpu;                    /* CPU running or queuing it. */
+	struct cpu *last_cpu;               /* CPU it last ran on. */
+	int64_t last_run;                   /* Tick it last started running. */
 	/* TO DO: add local tick(the time to wake up)*/
 	int64_t wakeup_tick;
+	struct list_elem allelem;           /* List element for all threads list. */
 	/* Shared between thread.c and synch.c. */
 	struct list_elem elem;              /* List element. */
 	
-	struct list donations; // 나에게 후원한 스레드들 리스트
-	struct list_elem d_elem; // 내가 후원할 스레드에게 내 정보를 저장하게 함
+	struct list held_locks;             /* Locks it holds. */
 	struct lock *wait_on_lock; // 내가 기다리는 락
+	struct semaphore *wait_sema;        /* Semaphore it is blocked on. */
+	struct rw_hold rw_holds[RW_HOLD_MAX]; /* Rwlocks it holds. */
 	int original_priority; // 내 priority가 후원을 받아서 높아져도 원래 priority를 저장하기 위해
 
 	int nice;
 	int recent_cpu;
+	int64_t recent_cpu_epoch;           /* MLFQS epoch of recent_cpu. */
 
 	struct thread *parent; // 부모 프로세스에 대한 포인터 // userprog
 	struct list_elem sibling_elem; // 형제 프로세스에 대한 리스트
@@ -138,6 +134,8 @@ struct thread {
 	enum load_status load_status; // load status // userprog
 
 	int exit_status;
+	struct semaphore exit_sema;         /* Upped when it exits. */
+	struct semaphore reap_sema;         /* Upped when its parent is done with it. */
 
 	struct file *fdt[64]; // file descriptor table 구조체(배열) //?**fdt?
 	int next_fd;
@@ -152,7 +150,9 @@ struct thread {
 #endif
 
 	/* Owned by thread.c. */
-	struct intr_frame tf;               /* Information for switching */
+	struct intr_frame tf;               /* Context for its first launch. */
+	uint64_t switch_rsp;                /* Saved stack pointer, 0 if never run. */
+	void *stack;                        /* Kernel stack block. */
 	unsigned magic;                     /* Detects stack overflow. */
 };
 
@@ -164,12 +164,18 @@ extern bool thread_mlfqs;
 
 void thread_init (void);
 void thread_start (void);
+struct thread *thread_init_ap (struct cpu *);
+void thread_start_ap (void) NO_RETURN;
 
 void thread_tick (void);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
+#ifdef USERPROG
+tid_t thread_create_child (const char *name, int priority, thread_func *,
+		void *);
+#endif
 
 void thread_block (void);
 void thread_unblock (struct thread *);
@@ -183,18 +189,26 @@ void thread_yield (void);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_update_priority (struct thread *, int);
+void thread_test_preemption (void);
+size_t thread_ready_count (void);
+size_t thread_running_count (void);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
+void thread_mlfqs_recompute_priority (void);
+void thread_mlfqs_update_recent_cpu (void);
+
+/* Performs some operation on thread t, given auxiliary data AUX. */
+typedef void thread_action_func (struct thread *t, void *aux);
+void thread_foreach (thread_action_func *, void *);
 
 void do_iret (struct intr_frame *tf);
 
-struct list ready_list;
-struct list sleep_list; 
+void thread_sleep (int64_t wakeup_tick);
 
-struct thread *idle_thread;
-int READY_THREADS;
-int LOAD_AVG;
+extern int READY_THREADS;
+extern int LOAD_AVG;
 #endif /* threads/thread.h */
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "threads/synch.h"
 
 void syscall_init (void);
+void syscall_init_cpu (void);
 
 // global lock 정의
 struct lock filesys_lock;
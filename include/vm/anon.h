@@ -1,13 +1,27 @@
 #ifndef VM_ANON_H
 #define VM_ANON_H
+#include <stddef.h>
+#include <stdint.h>
 #include "vm/vm.h"
 struct page;
 enum vm_type;
 
+/* Swap slot of an anonymous page that is in memory. */
+#define SWAP_SLOT_NONE SIZE_MAX
+
+/* Most pages moved to or from swap with one disk command. */
+#define SWAP_CLUSTER 8
+
 struct anon_page {
+	size_t slot;           /* Swap slot, or SWAP_SLOT_NONE. */
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void anon_read_swap (struct page *page, void *kva);
+size_t anon_swap_out_cluster (struct page *pages[], size_t cnt);
+size_t anon_swap_around (struct page *page, struct page *around[],
+		size_t max);
+void anon_swap_in_cluster (struct page *pages[], void *kvas[], size_t cnt);
 
 #endif
@@ -7,6 +7,9 @@ struct page;
 enum vm_type;
 
 struct file_page {
+	struct file *file;     /* File, owned by the page's vm_region. */
+	off_t offset;          /* Offset of the page's data in FILE. */
+	size_t read_bytes;     /* Bytes from FILE; the rest are zeros. */
 };
 
 void vm_file_init (void);
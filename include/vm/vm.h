@@ -1,6 +1,9 @@
 #ifndef VM_VM_H
 #define VM_VM_H
+#include <hash.h>
+#include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "threads/palloc.h"
 
 enum vm_type {
@@ -46,6 +49,8 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
+	bool writable;         /* Mapped writable in user space? */
+	struct hash_elem spt_elem;  /* Element in supplemental_page_table. */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -63,6 +68,8 @@ struct page {
 struct frame {
 	void *kva;
 	struct page *page;
+	uint64_t *pml4;             /* Page table that maps PAGE. */
+	struct list_elem elem;      /* Element in the frame table. */
 };
 
 /* The function table for page operations.
@@ -81,10 +88,31 @@ struct page_operations {
 #define destroy(page) \
 	if ((page)->operations->destroy) (page)->operations->destroy (page)
 
+/* Kinds of region of a process's address space. */
+enum vm_region_kind {
+	VM_REGION_CODE,        /* Read-only ELF segment. */
+	VM_REGION_DATA,        /* Writable ELF segment. */
+	VM_REGION_STACK,       /* User stack. */
+	VM_REGION_MMAP,        /* Memory-mapped file. */
+};
+
+/* A region: the pages [START, END) that one ELF segment, the
+ * stack, or one mmap() set up together. */
+struct vm_region {
+	uint8_t *start;             /* First page. */
+	uint8_t *end;               /* One past the last page. */
+	enum vm_region_kind kind;   /* What the region holds. */
+	struct file *file;          /* Mapped file, owned, or null. */
+	struct list_elem elem;      /* Element in supplemental_page_table. */
+};
+
 /* Representation of current process's memory space.
- * We don't want to force you to obey any specific design for this struct.
- * All designs up to you for this. */
+ * PAGES finds the page at an address in O(1), for page faults.
+ * REGIONS indexes the same pages by range, so that operations on
+ * a range of addresses visit only the pages in that range. */
 struct supplemental_page_table {
+	struct hash pages;          /* struct pages, by VA. */
+	struct list regions;        /* Disjoint vm_regions, by START. */
 };
 
 #include "threads/thread.h"
@@ -96,8 +124,17 @@ struct page *spt_find_page (struct supplemental_page_table *spt,
 		void *va);
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
+struct vm_region *spt_add_region (struct supplemental_page_table *spt,
+		void *start, void *end, enum vm_region_kind kind);
+struct vm_region *spt_find_region (struct supplemental_page_table *spt,
+		const void *addr);
+bool spt_range_is_free (struct supplemental_page_table *spt,
+		const void *start, const void *end);
+void spt_remove_region (struct supplemental_page_table *spt,
+		struct vm_region *region);
 
 void vm_init (void);
+void vm_print_stats (void);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 		bool write, bool not_present);
 
@@ -0,0 +1,53 @@
+/* Checks that cond_wait_timeout() gives up after exactly the
+   given number of ticks when nobody signals, reacquiring the lock
+   either way, and that a signal before then wakes it. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+static thread_func signal_thread;
+
+static struct lock lock;
+static struct condition condition;
+
+void
+test_cond_wait_timeout (void) 
+{
+  int64_t start;
+  bool signaled;
+
+  lock_init (&lock);
+  cond_init (&condition);
+  lock_acquire (&lock);
+
+  timer_sleep (1);
+  start = timer_ticks ();
+  signaled = cond_wait_timeout (&condition, &lock, 10);
+  msg ("Returned %s after %"PRId64" ticks, %s the lock.",
+       signaled ? "true" : "false", timer_elapsed (start),
+       lock_held_by_current_thread (&lock) ? "holding" : "not holding");
+
+  /* Nobody waits now, so this signal is lost. */
+  cond_signal (&condition, &lock);
+
+  thread_create ("signal", PRI_DEFAULT - 1, signal_thread, NULL);
+  signaled = cond_wait_timeout (&condition, &lock, 100);
+  msg ("Returned %s, %s the lock.",
+       signaled ? "true" : "false",
+       lock_held_by_current_thread (&lock) ? "holding" : "not holding");
+  lock_release (&lock);
+}
+
+static void
+signal_thread (void *aux UNUSED) 
+{
+  lock_acquire (&lock);
+  msg ("Signaling...");
+  cond_signal (&condition, &lock);
+  lock_release (&lock);
+}
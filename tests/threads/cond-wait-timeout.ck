@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(cond-wait-timeout) begin
+(cond-wait-timeout) Returned false after 10 ticks, holding the lock.
+(cond-wait-timeout) Signaling...
+(cond-wait-timeout) Returned true, holding the lock.
+(cond-wait-timeout) end
+EOF
+pass;
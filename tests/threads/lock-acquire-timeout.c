@@ -0,0 +1,66 @@
+/* The main thread acquires a lock, then creates a higher-priority
+   thread that tries to acquire it with a timeout.  That thread
+   donates its priority while it waits and takes the donation back
+   when it gives up.  A second such thread, with a longer timeout,
+   gets the lock when the main thread releases it. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+static thread_func acquire_thread;
+
+struct acquire_args
+  {
+    struct lock *lock;
+    int64_t ticks;
+  };
+
+void
+test_lock_acquire_timeout (void) 
+{
+  struct lock lock;
+  struct acquire_args args;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  lock_init (&lock);
+  lock_acquire (&lock);
+  args.lock = &lock;
+
+  args.ticks = 10;
+  thread_create ("acquire1", PRI_DEFAULT + 1, acquire_thread, &args);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 1, thread_get_priority ());
+  timer_sleep (20);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT, thread_get_priority ());
+
+  args.ticks = 100;
+  thread_create ("acquire2", PRI_DEFAULT + 1, acquire_thread, &args);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 1, thread_get_priority ());
+  lock_release (&lock);
+  msg ("acquire2 must already have finished.");
+}
+
+static void
+acquire_thread (void *args_) 
+{
+  struct acquire_args *args = args_;
+
+  if (lock_acquire_timeout (args->lock, args->ticks))
+    {
+      msg ("%s: got the lock", thread_name ());
+      lock_release (args->lock);
+    }
+  else
+    msg ("%s: timed out", thread_name ());
+}
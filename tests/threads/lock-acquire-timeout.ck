@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(lock-acquire-timeout) begin
+(lock-acquire-timeout) This thread should have priority 32.  Actual priority: 32.
+(lock-acquire-timeout) acquire1: timed out
+(lock-acquire-timeout) This thread should have priority 31.  Actual priority: 31.
+(lock-acquire-timeout) This thread should have priority 32.  Actual priority: 32.
+(lock-acquire-timeout) acquire2: got the lock
+(lock-acquire-timeout) acquire2 must already have finished.
+(lock-acquire-timeout) end
+EOF
+pass;
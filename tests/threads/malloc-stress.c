@@ -0,0 +1,131 @@
+/* Stress test and benchmark for threads/malloc.c.
+
+   Runs several threads that allocate and free blocks of random
+   sizes for a fixed time, checking that no two live blocks
+   overlap, then reports how many allocations per second they
+   managed in total.  It runs once with a single thread and once
+   with several, to show how well the per-CPU magazines keep the
+   descriptor locks out of the way; run with -smp to make the
+   second run contend.  The rates depend on the machine, so only
+   their presence is checked. */
+
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Number of worker threads in the parallel run. */
+#define THREAD_CNT 8
+
+/* Blocks each worker keeps live at once. */
+#define LIVE_CNT 64
+
+/* Largest block requested, small enough to stay off the page
+   allocator. */
+#define MAX_SIZE 1024
+
+/* How long each run lasts, in timer ticks. */
+#define RUN_TICKS (2 * TIMER_FREQ)
+
+/* A worker's state. */
+struct worker 
+  {
+    int id;                     /* Fill byte for its blocks. */
+    int64_t end;                /* Tick at which to stop. */
+    uint64_t alloc_cnt;         /* Allocations made. */
+    struct semaphore done;      /* Upped when finished. */
+  };
+
+static thread_func worker_func;
+static uint64_t run (int thread_cnt);
+
+/* Benchmarks malloc() and free(). */
+void
+test_malloc_stress (void) 
+{
+  uint64_t one, many;
+
+  random_init (0);
+
+  one = run (1);
+  msg ("1 thread: %"PRIu64" allocations/s.", one);
+
+  many = run (THREAD_CNT);
+  msg ("%d threads: %"PRIu64" allocations/s.", THREAD_CNT, many);
+}
+
+/* Runs THREAD_CNT workers for RUN_TICKS and returns their total
+   allocations per second. */
+static uint64_t
+run (int thread_cnt) 
+{
+  static struct worker workers[THREAD_CNT];
+  uint64_t total = 0;
+  int64_t start;
+  int i;
+
+  ASSERT (thread_cnt <= THREAD_CNT);
+
+  start = timer_ticks ();
+  for (i = 0; i < thread_cnt; i++) 
+    {
+      struct worker *w = &workers[i];
+      char name[16];
+
+      w->id = i + 1;
+      w->end = start + RUN_TICKS;
+      w->alloc_cnt = 0;
+      sema_init (&w->done, 0);
+      snprintf (name, sizeof name, "malloc %d", i);
+      thread_create (name, PRI_DEFAULT, worker_func, w);
+    }
+
+  for (i = 0; i < thread_cnt; i++) 
+    {
+      sema_down (&workers[i].done);
+      total += workers[i].alloc_cnt;
+    }
+  return total * TIMER_FREQ / timer_elapsed (start);
+}
+
+/* Allocates and frees random blocks until W->end, verifying that
+   each freed block still holds what was written into it. */
+static void
+worker_func (void *w_) 
+{
+  struct worker *w = w_;
+  uint8_t *blocks[LIVE_CNT];
+  size_t sizes[LIVE_CNT];
+  size_t i, j;
+
+  memset (blocks, 0, sizeof blocks);
+  while (timer_ticks () < w->end) 
+    {
+      i = random_ulong () % LIVE_CNT;
+      if (blocks[i] != NULL) 
+        {
+          for (j = 0; j < sizes[i]; j++)
+            if (blocks[i][j] != w->id)
+              fail ("block %p of %zu bytes corrupted at byte %zu",
+                    blocks[i], sizes[i], j);
+          free (blocks[i]);
+        }
+
+      sizes[i] = random_ulong () % MAX_SIZE + 1;
+      blocks[i] = malloc (sizes[i]);
+      if (blocks[i] == NULL)
+        fail ("malloc of %zu bytes failed", sizes[i]);
+      memset (blocks[i], w->id, sizes[i]);
+      w->alloc_cnt++;
+    }
+
+  for (i = 0; i < LIVE_CNT; i++)
+    free (blocks[i]);
+  sema_up (&w->done);
+}
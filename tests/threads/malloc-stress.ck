@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing single-thread rate in output"
+  unless grep (/^\(malloc-stress\) 1 thread: \d+ allocations\/s\.$/, @output);
+fail "missing multi-thread rate in output"
+  unless grep (/^\(malloc-stress\) \d+ threads: \d+ allocations\/s\.$/,
+               @output);
+
+pass;
@@ -0,0 +1,70 @@
+/* Checks that a palloc_watcher hears when the user pool's free
+   pages fall below its low watermark and when they come back up
+   to its high watermark, and only then. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "devices/timer.h"
+
+#define PAGE_CNT 16
+
+static struct semaphore low_sema, high_sema;
+static int low_cnt, high_cnt;
+
+static void
+on_low (void *aux UNUSED) 
+{
+  low_cnt++;
+  sema_up (&low_sema);
+}
+
+static void
+on_high (void *aux UNUSED) 
+{
+  high_cnt++;
+  sema_up (&high_sema);
+}
+
+void
+test_mem_pressure (void) 
+{
+  struct palloc_watcher w = { .user = true, .low = on_low, .high = on_high };
+  static void *pages[PAGE_CNT];
+  size_t free_cnt;
+  int i;
+
+  sema_init (&low_sema, 0);
+  sema_init (&high_sema, 0);
+  palloc_watch (&w);
+
+  free_cnt = palloc_free_cnt (true);
+  ASSERT (free_cnt > PAGE_CNT);
+  palloc_set_watermarks (true, free_cnt - PAGE_CNT / 2,
+                         free_cnt - PAGE_CNT / 4);
+
+  for (i = 0; i < PAGE_CNT; i++) 
+    {
+      pages[i] = palloc_get_page (PAL_USER);
+      if (pages[i] == NULL)
+        fail ("allocation %d failed", i);
+    }
+  sema_down (&low_sema);
+  msg ("Low callback ran %d times.", low_cnt);
+
+  /* Back above the low watermark, but not yet at the high one. */
+  for (i = 0; i < PAGE_CNT / 2 + 1; i++)
+    palloc_free_page (pages[i]);
+  timer_msleep (100);
+  msg ("High callback ran %d times below the high watermark.", high_cnt);
+
+  for (; i < PAGE_CNT; i++)
+    palloc_free_page (pages[i]);
+  sema_down (&high_sema);
+  msg ("High callback ran %d times.", high_cnt);
+
+  palloc_unwatch (&w);
+  msg ("Low callback ran %d times in all.", low_cnt);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(mem-pressure) begin
+(mem-pressure) Low callback ran 1 times.
+(mem-pressure) High callback ran 0 times below the high watermark.
+(mem-pressure) High callback ran 1 times.
+(mem-pressure) Low callback ran 1 times in all.
+(mem-pressure) end
+EOF
+pass;
@@ -0,0 +1,63 @@
+/* The main thread acquires a reader-writer lock for reading.
+   Then it creates a higher-priority writer and a reader of
+   priority in between, both of which block: the writer because
+   the lock is held, and the reader because a writer waits ahead
+   of it.  Both donate their priorities to the main thread.  When
+   the main thread releases the lock, the writer should get it
+   first, then the reader. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func reader_thread_func;
+static thread_func writer_thread_func;
+
+void
+test_priority_donate_rwlock (void) 
+{
+  struct rwlock rw;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  rwlock_init (&rw);
+  rwlock_read_acquire (&rw);
+  thread_create ("writer", PRI_DEFAULT + 2, writer_thread_func, &rw);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 2, thread_get_priority ());
+  thread_create ("reader", PRI_DEFAULT + 1, reader_thread_func, &rw);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 2, thread_get_priority ());
+  rwlock_read_release (&rw);
+  msg ("writer, reader must already have finished, in that order.");
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT, thread_get_priority ());
+}
+
+static void
+reader_thread_func (void *rw_) 
+{
+  struct rwlock *rw = rw_;
+
+  rwlock_read_acquire (rw);
+  msg ("reader: got the lock");
+  rwlock_read_release (rw);
+  msg ("reader: done");
+}
+
+static void
+writer_thread_func (void *rw_) 
+{
+  struct rwlock *rw = rw_;
+
+  rwlock_write_acquire (rw);
+  msg ("writer: got the lock");
+  rwlock_write_release (rw);
+  msg ("writer: done");
+}
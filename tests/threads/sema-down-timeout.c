@@ -0,0 +1,53 @@
+/* Checks that sema_down_timeout() gives up after exactly the
+   given number of ticks when nobody ups the semaphore, and that
+   an up before then wakes it right away. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+static thread_func up_thread;
+
+void
+test_sema_down_timeout (void) 
+{
+  struct semaphore sema;
+  int64_t start;
+  bool success;
+
+  sema_init (&sema, 0);
+
+  success = sema_down_timeout (&sema, 0);
+  msg ("Zero timeout returned %s.", success ? "true" : "false");
+
+  /* Start on a tick boundary. */
+  timer_sleep (1);
+  start = timer_ticks ();
+  success = sema_down_timeout (&sema, 10);
+  msg ("Returned %s after %"PRId64" ticks.", success ? "true" : "false",
+       timer_elapsed (start));
+
+  timer_sleep (1);
+  start = timer_ticks ();
+  thread_create ("up", PRI_DEFAULT + 1, up_thread, &sema);
+  success = sema_down_timeout (&sema, 100);
+  msg ("Returned %s after %"PRId64" ticks.", success ? "true" : "false",
+       timer_elapsed (start));
+
+  sema_up (&sema);
+  success = sema_down_timeout (&sema, 10);
+  msg ("Returned %s at once.", success ? "true" : "false");
+}
+
+static void
+up_thread (void *sema_) 
+{
+  struct semaphore *sema = sema_;
+
+  timer_sleep (5);
+  sema_up (sema);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sema-down-timeout) begin
+(sema-down-timeout) Zero timeout returned false.
+(sema-down-timeout) Returned false after 10 ticks.
+(sema-down-timeout) Returned true after 5 ticks.
+(sema-down-timeout) Returned true at once.
+(sema-down-timeout) end
+EOF
+pass;
@@ -0,0 +1,79 @@
+/* Checks that a kmem_cache hands out distinct, aligned objects,
+   runs the constructor once per object rather than once per
+   allocation, and reuses freed objects. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/slab.h"
+
+#define OBJ_CNT 100
+#define OBJ_ALIGN 64
+
+struct obj 
+  {
+    struct obj *link;           /* Clobbered while free. */
+    int constructed;            /* Set by the constructor. */
+    char data[84];
+  };
+
+static int ctor_cnt;
+
+static void
+obj_ctor (void *p) 
+{
+  struct obj *o = p;
+
+  o->constructed = 1;
+  ctor_cnt++;
+}
+
+void
+test_slab_cache (void) 
+{
+  static struct obj *objs[OBJ_CNT];
+  struct kmem_cache *cache;
+  int first_ctor_cnt;
+  int i, j;
+
+  cache = kmem_cache_create ("slab-cache", sizeof (struct obj), OBJ_ALIGN,
+                             obj_ctor);
+  ASSERT (cache != NULL);
+
+  for (i = 0; i < OBJ_CNT; i++) 
+    {
+      objs[i] = kmem_cache_alloc (cache);
+      if (objs[i] == NULL)
+        fail ("allocation %d failed", i);
+      if ((uintptr_t) objs[i] % OBJ_ALIGN != 0)
+        fail ("object %d at %p is misaligned", i, objs[i]);
+      if (!objs[i]->constructed)
+        fail ("object %d was not constructed", i);
+      memset (objs[i]->data, i, sizeof objs[i]->data);
+    }
+  msg ("Allocated %d aligned, constructed objects.", OBJ_CNT);
+
+  for (i = 0; i < OBJ_CNT; i++)
+    for (j = 0; j < (int) sizeof objs[i]->data; j++)
+      if (objs[i]->data[j] != (char) i)
+        fail ("object %d overlaps another object", i);
+  msg ("Objects do not overlap.");
+
+  /* Free every other object, so that no slab empties. */
+  first_ctor_cnt = ctor_cnt;
+  for (i = 0; i < OBJ_CNT; i += 2)
+    kmem_cache_free (cache, objs[i]);
+  for (i = 0; i < OBJ_CNT; i += 2) 
+    {
+      objs[i] = kmem_cache_alloc (cache);
+      if (objs[i] == NULL || !objs[i]->constructed)
+        fail ("reallocation %d failed", i);
+    }
+  msg ("Reallocation ran the constructor %d more times.",
+       ctor_cnt - first_ctor_cnt);
+
+  for (i = 0; i < OBJ_CNT; i++)
+    kmem_cache_free (cache, objs[i]);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(slab-cache) begin
+(slab-cache) Allocated 100 aligned, constructed objects.
+(slab-cache) Objects do not overlap.
+(slab-cache) Reallocation ran the constructor 0 more times.
+(slab-cache) end
+EOF
+pass;
@@ -0,0 +1,68 @@
+/* Runs with two CPUs (pintos --smp 2).  Checks that the second
+   CPU comes up and runs threads, and that an adaptive lock keeps
+   threads on different CPUs from losing each other's updates to a
+   shared counter. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/mp.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define THREAD_CNT 4
+#define ITER_CNT 10000
+
+static struct lock lock;
+static struct semaphore done;
+static int counter;
+static bool ran_on[CPU_MAX];
+
+static thread_func count_thread;
+
+void
+test_smp_lock (void) 
+{
+  int i, cpus_used;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  msg ("%d CPUs.", cpu_cnt);
+  if (cpu_cnt < 2)
+    fail ("second CPU did not start");
+
+  lock_init (&lock);
+  lock_set_adaptive (&lock, true);
+  sema_init (&done, 0);
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "count %d", i);
+      thread_create (name, PRI_DEFAULT, count_thread, NULL);
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+
+  cpus_used = 0;
+  for (i = 0; i < cpu_cnt; i++)
+    if (ran_on[i])
+      cpus_used++;
+  msg ("Counting threads ran on %d CPUs.", cpus_used);
+  msg ("Counter is %d, expected %d.", counter, THREAD_CNT * ITER_CNT);
+}
+
+static void
+count_thread (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < ITER_CNT; i++)
+    {
+      lock_acquire (&lock);
+      ran_on[thread_current ()->cpu->id] = true;
+      counter++;
+      lock_release (&lock);
+    }
+  sema_up (&done);
+}
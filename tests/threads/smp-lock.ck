@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(smp-lock) begin
+(smp-lock) 2 CPUs.
+(smp-lock) Counting threads ran on 2 CPUs.
+(smp-lock) Counter is 40000, expected 40000.
+(smp-lock) end
+EOF
+pass;
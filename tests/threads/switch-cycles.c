@@ -0,0 +1,47 @@
+/* Measures the cost of a thread switch.  The main thread and a
+   second thread of the same priority yield to each other back and
+   forth, and the time-stamp counter gives the average number of
+   CPU cycles per switch.  The count depends on the machine, so
+   only its presence is checked.  Run with a single CPU, or the two
+   threads may run side by side rather than switching. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/thread.h"
+#include "intrinsic.h"
+
+/* Number of round trips between the two threads. */
+#define ROUND_TRIPS 10000
+
+static thread_func yield_thread;
+
+void
+test_switch_cycles (void) 
+{
+  uint64_t start, cycles;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  thread_create ("yield", PRI_DEFAULT, yield_thread, NULL);
+
+  start = rdtsc ();
+  for (i = 0; i < ROUND_TRIPS; i++)
+    thread_yield ();
+  cycles = rdtsc () - start;
+
+  msg ("%d switches, %"PRIu64" cycles per switch.",
+       2 * ROUND_TRIPS, cycles / (2 * ROUND_TRIPS));
+}
+
+static void
+yield_thread (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < ROUND_TRIPS; i++)
+    thread_yield ();
+}
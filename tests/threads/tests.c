@@ -25,6 +25,15 @@ static const struct test tests[] =
     {"priority-donate-sema", test_priority_donate_sema},
     {"priority-donate-lower", test_priority_donate_lower},
     {"priority-donate-chain", test_priority_donate_chain},
+    {"priority-donate-rwlock", test_priority_donate_rwlock},
+    {"sema-down-timeout", test_sema_down_timeout},
+    {"lock-acquire-timeout", test_lock_acquire_timeout},
+    {"cond-wait-timeout", test_cond_wait_timeout},
+    {"switch-cycles", test_switch_cycles},
+    {"malloc-stress", test_malloc_stress},
+    {"slab-cache", test_slab_cache},
+    {"mem-pressure", test_mem_pressure},
+    {"smp-lock", test_smp_lock},
     {"priority-fifo", test_priority_fifo},
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
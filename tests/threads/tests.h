@@ -19,6 +19,15 @@ extern test_func test_priority_donate_sema;
 extern test_func test_priority_donate_nest;
 extern test_func test_priority_donate_lower;
 extern test_func test_priority_donate_chain;
+extern test_func test_priority_donate_rwlock;
+extern test_func test_sema_down_timeout;
+extern test_func test_lock_acquire_timeout;
+extern test_func test_cond_wait_timeout;
+extern test_func test_switch_cycles;
+extern test_func test_malloc_stress;
+extern test_func test_slab_cache;
+extern test_func test_mem_pressure;
+extern test_func test_smp_lock;
 extern test_func test_priority_fifo;
 extern test_func test_priority_preempt;
 extern test_func test_priority_sema;
@@ -3,6 +3,7 @@
 #include <debug.h>
 #include <limits.h>
 #include <random.h>
+#include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -15,11 +16,14 @@
 #include "devices/vga.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/kstack.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
+#include "threads/mp.h"
 #include "threads/mmu.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -85,7 +89,11 @@ main (void) {
 	/* Initialize memory system. */
 	mem_end = palloc_init ();
 	malloc_init ();
+	kstack_init ();
+	kmem_init ();
 	paging_init (mem_end);
+	mp_init ();
+	mmu_init_cpu ();
 
 #ifdef USERPROG
 	tss_init ();
@@ -105,6 +113,8 @@ main (void) {
 	thread_start ();
 	serial_init_queue ();
 	timer_calibrate ();
+	mp_start_aps ();
+	palloc_start_threads ();
 
 #ifdef FILESYS
 	/* Initialize file system. */
@@ -142,7 +152,14 @@ bss_init (void) {
 
 /* Populates the page table with the kernel virtual mapping,
  * and then sets up the CPU to use the new page directory.
- * Points base_pml4 to the pml4 it creates. */
+ * Points base_pml4 to the pml4 it creates.
+ *
+ * Memory is mapped in 2 MB pages, which take 512 times fewer page
+ * table entries and TLB entries than 4 kB pages.  The 2 MB pages
+ * that hold kernel text, which is read-only, are mapped in 4 kB
+ * pages instead, and so are the first 2 MB, where the BIOS and
+ * video memory have their own memory types, and any part of a
+ * 2 MB page past the end of memory. */
 static void
 paging_init (uint64_t mem_end) {
 	uint64_t *pml4, *pte;
@@ -150,17 +167,30 @@ paging_init (uint64_t mem_end) {
 	pml4 = base_pml4 = palloc_get_page (PAL_ASSERT | PAL_ZERO);
 
 	extern char start, _end_kernel_text;
+	uint64_t text_start = ROUND_DOWN (vtop (&start), HUGE_PGSIZE);
+	uint64_t text_end = ROUND_UP (vtop (&_end_kernel_text), HUGE_PGSIZE);
+
 	// Maps physical address [0 ~ mem_end] to
 	//   [LOADER_KERN_BASE ~ LOADER_KERN_BASE + mem_end].
-	for (uint64_t pa = 0; pa < mem_end; pa += PGSIZE) {
+	for (uint64_t pa = 0; pa < mem_end; ) {
 		uint64_t va = (uint64_t) ptov(pa);
 
+		if (pa % HUGE_PGSIZE == 0 && pa != 0
+				&& pa + HUGE_PGSIZE <= mem_end
+				&& (pa >= text_end || pa + HUGE_PGSIZE <= text_start)) {
+			if ((pte = pml4_pde_walk (pml4, va, 1)) != NULL)
+				*pte = pa | PTE_P | PTE_W | PTE_PS;
+			pa += HUGE_PGSIZE;
+			continue;
+		}
+
 		perm = PTE_P | PTE_W;
 		if ((uint64_t) &start <= va && va < (uint64_t) &_end_kernel_text)
 			perm &= ~PTE_W;
 
 		if ((pte = pml4e_walk (pml4, va, 1)) != NULL)
 			*pte = pa | perm;
+		pa += PGSIZE;
 	}
 
 	// reload cr3
@@ -221,6 +251,16 @@ parse_options (char **argv) {
 			random_init (atoi (value));
 		else if (!strcmp (name, "-mlfqs"))
 			thread_mlfqs = true;
+		else if (!strcmp (name, "-tickless"))
+			timer_tickless = true;
+		else if (!strcmp (name, "-up")) {
+			int percent = value != NULL ? atoi (value) : -1;
+			if (percent < 0 || percent > 100)
+				PANIC ("-up: PERCENT must be between 0 and 100");
+			user_pool_percent = percent;
+		}
+		else if (!strcmp (name, "-dynpool"))
+			palloc_dynamic = true;
 #ifdef USERPROG
 		else if (!strcmp (name, "-ul"))
 			user_page_limit = atoi (value);
@@ -326,6 +366,9 @@ usage (void) {
 			"  -f                 Format file system disk during startup.\n"
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
+			"  -tickless          Stop the periodic timer tick while idle.\n"
+			"  -up=PERCENT        Give PERCENT of memory to the user pool.\n"
+			"  -dynpool           Let memory pools borrow from each other.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
@@ -354,6 +397,11 @@ static void
 print_stats (void) {
 	timer_print_stats ();
 	thread_print_stats ();
+	palloc_print_stats ();
+	kmem_print_stats ();
+#ifdef VM
+	vm_print_stats ();
+#endif
 #ifdef FILESYS
 	disk_print_stats ();
 #endif
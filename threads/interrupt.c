@@ -6,10 +6,15 @@
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/lapic.h"
+#include "threads/mp.h"
+#include "threads/kstack.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
+#include "userprog/tss.h"
 #include "intrinsic.h"
 #ifdef USERPROG
 #include "userprog/gdt.h"
@@ -99,14 +104,44 @@ static const char *intr_names[INTR_CNT];
    pre-empted.  Handlers for external interrupts also may not
    sleep, although they may invoke intr_yield_on_return() to
    request that a new process be scheduled just before the
-   interrupt returns. */
-static bool in_external_intr;   /* Are we processing an external interrupt? */
-static bool yield_on_return;    /* Should we yield on interrupt return? */
+   interrupt returns.  Whether each CPU is in an external
+   interrupt is kept in its struct cpu.
+
+   Vectors 0x20...0x2f come from the PICs and 0x30...0x3f from
+   the local APIC. */
+#define is_external(VEC) ((VEC) >= 0x20 && (VEC) < 0x40)
+
+/* Kernel lock.
+
+   Once more than one CPU is running, turning interrupts off is
+   not enough to keep other threads out, so each CPU also holds
+   this lock whenever its interrupts are off.  Code that relies on
+   intr_disable() for mutual exclusion thus keeps working
+   unchanged, at the cost of serializing such code across CPUs:
+   it is one big kernel lock, not a way to scale.  With a single
+   CPU the lock is never touched. */
+static struct spinlock intr_lock;
+static bool intr_smp;           /* Is intr_lock in use? */
+
+#ifndef USERPROG
+/* Kernels without user programs never run gdt_init() or
+   tss_init(), but a double fault still needs a TSS to find its
+   stack.  Each CPU gets a GDT with the kernel code and data
+   segments of the temporary GDT in thread.c plus a TSS
+   descriptor at SEL_TSS, and a TSS that sets only IST1. */
+static uint64_t kernel_gdts[CPU_MAX][SEL_CNT];
+static struct task_state kernel_tsses[CPU_MAX];
+
+static void kernel_tss_init (void);
+static void kernel_tss_load (void);
+#endif
 
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
 
+static void double_fault (struct intr_frame *);
+
 /* Interrupt handlers. */
 void intr_handler (struct intr_frame *args);
 
@@ -142,6 +177,8 @@ intr_enable (void) {
 
 	   See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
 	   Hardware Interrupts". */
+	if (old_level == INTR_OFF && intr_smp)
+		spin_unlock (&intr_lock);
 	asm volatile ("sti");
 
 	return old_level;
@@ -156,10 +193,88 @@ intr_disable (void) { //인터럽트를 비활성화하고 이전 인터럽트 
 	   See [IA32-v2b] "CLI" and [IA32-v3a] 5.8.1 "Masking Maskable
 	   Hardware Interrupts". */
 	asm volatile ("cli" : : : "memory");
+	if (old_level == INTR_ON && intr_smp)
+		spin_lock (&intr_lock);
 
 	return old_level;
 }
 
+/* Enables interrupts and waits for the next one, atomically.
+   Interrupts must be off.
+
+   The `sti' instruction disables interrupts until the completion
+   of the next instruction, so these two instructions are executed
+   atomically.  This atomicity is important; otherwise, an
+   interrupt could be handled between re-enabling interrupts and
+   waiting for the next one to occur, wasting as much as one clock
+   tick worth of time.
+
+   See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a] 7.11.1
+   "HLT Instruction". */
+void
+intr_halt (void) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (!intr_context ());
+
+	if (intr_smp)
+		spin_unlock (&intr_lock);
+	asm volatile ("sti; hlt" : : : "memory");
+}
+
+/* Starts using the kernel lock.  Called on the boot CPU, with
+   interrupts on, before any other CPU is started. */
+void
+intr_start_smp (void) {
+	ASSERT (intr_get_level () == INTR_ON);
+	spin_init (&intr_lock);
+	intr_smp = true;
+}
+
+/* Prepares an application processor, which starts out with
+   interrupts off, to take interrupts: loads the IDT built by
+   intr_init(), and in kernels without user programs the GDT and
+   TSS for its double fault stack, and takes the kernel lock. */
+void
+intr_init_ap (void) {
+	ASSERT (intr_smp);
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	lidt (&idt_desc);
+#ifndef USERPROG
+	kernel_tss_load ();
+#endif
+	spin_lock (&intr_lock);
+}
+
+/* Reschedule IPI, sent by thread_unblock() when it readies a
+   thread for another CPU that should run it now. */
+static void
+resched_interrupt (struct intr_frame *args UNUSED) {
+	intr_yield_on_return ();
+}
+
+/* The local APIC raises its spurious vector instead of an
+   interrupt that went away before it could be delivered.  It
+   must not be acknowledged. */
+static void
+spurious_interrupt (struct intr_frame *args UNUSED) {
+}
+
+/* Double fault handler.  Runs on the running CPU's double fault
+   stack, so it works even when the kernel stack is gone. */
+static void
+double_fault (struct intr_frame *f) {
+	void *stack = thread_current ()->stack;
+	void *rsp = (void *) f->rsp;
+
+	intr_dump_frame (f);
+	/* The stack pointer at the first fault is in or just above
+	   the guard page. */
+	if (kstack_in_guard (stack, rsp) || kstack_in_guard (stack, rsp - PGSIZE))
+		PANIC ("Kernel stack overflow in thread %s", thread_name ());
+	PANIC ("Double fault");
+}
+
 /* Initializes the interrupt system. */
 void
 intr_init (void) {
@@ -177,6 +292,9 @@ intr_init (void) {
 #ifdef USERPROG
 	/* Load TSS. */
 	ltr (SEL_TSS);
+#else
+	kernel_tss_init ();
+	kernel_tss_load ();
 #endif
 
 	/* Load IDT register. */
@@ -202,6 +320,16 @@ intr_init (void) {
 	intr_names[17] = "#AC Alignment Check Exception";
 	intr_names[18] = "#MC Machine-Check Exception";
 	intr_names[19] = "#XF SIMD Floating-Point Exception";
+
+	/* A kernel stack that runs into its guard page cannot take the
+	   page fault that follows, so the CPU raises a double fault
+	   instead.  Handle that on a stack of its own. */
+	intr_register_int (8, 0, INTR_OFF, double_fault, "#DF Double Fault");
+	intr_set_ist (8, TSS_IST_DF);
+
+	intr_register_ext (LAPIC_VEC_RESCHED, resched_interrupt, "Reschedule IPI");
+	intr_register_int (LAPIC_VEC_SPURIOUS, 0, INTR_OFF, spurious_interrupt,
+			"APIC spurious interrupt");
 }
 
 /* Registers interrupt VEC_NO to invoke HANDLER with descriptor
@@ -228,7 +356,7 @@ register_handler (uint8_t vec_no, int dpl, enum intr_level level,
 void
 intr_register_ext (uint8_t vec_no, intr_handler_func *handler,
 		const char *name) {
-	ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+	ASSERT (is_external (vec_no));
 	register_handler (vec_no, 0, INTR_OFF, handler, name);
 }
 
@@ -258,15 +386,79 @@ void
 intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
 		intr_handler_func *handler, const char *name)
 {
-	ASSERT (vec_no < 0x20 || vec_no > 0x2f);  // vec_no가 0x20 미만이거나 0x2f 초과인지 확인
+	ASSERT (!is_external (vec_no));  // vec_no가 외부 인터럽트 범위 밖인지 확인
 	register_handler (vec_no, dpl, level, handler, name);  // 핸들러를 등록
 }
 
+/* Makes the CPU handle interrupt VEC_NO, which must already be
+   registered, on the stack in slot IST (1...7) of its TSS's
+   interrupt stack table, instead of the interrupted stack.  This
+   is for faults, like a double fault, that the interrupted stack
+   may be unable to take. */
+void
+intr_set_ist (uint8_t vec_no, int ist) {
+	ASSERT (intr_handlers[vec_no] != NULL);
+	ASSERT (ist >= 1 && ist <= 7);
+	idt[vec_no].ist = ist;
+}
+
+#ifndef USERPROG
+/* Gives every CPU a TSS whose IST1 is a double fault stack. */
+static void
+kernel_tss_init (void) {
+	for (int i = 0; i < cpu_cnt; i++) {
+		void *df_stack = kstack_alloc ();
+
+		if (df_stack == NULL)
+			PANIC ("kernel_tss_init: out of memory");
+		kernel_tsses[i].ist1 = KSTACK_TOP (df_stack);
+		cpus[i].tss = &kernel_tsses[i];
+	}
+}
+
+/* Loads the running CPU's GDT and TSS. */
+static void
+kernel_tss_load (void) {
+	int id = cpu_current ()->id;
+	uint64_t *gdt = kernel_gdts[id];
+	uint64_t base = (uint64_t) &kernel_tsses[id];
+	uint64_t limit = sizeof (struct task_state) - 1;
+	struct desc_ptr gdt_ds = {
+		.size = sizeof kernel_gdts[id] - 1,
+		.address = (uint64_t) gdt
+	};
+
+	gdt[SEL_KCSEG >> 3] = 0x00af9a000000ffff;
+	gdt[SEL_KDSEG >> 3] = 0x00cf92000000ffff;
+
+	/* A present, available 64-bit TSS takes two slots. */
+	gdt[SEL_TSS >> 3] = (limit & 0xffff) | (base & 0xffffff) << 16
+		| (uint64_t) 0x89 << 40 | ((limit >> 16) & 0xf) << 48
+		| ((base >> 24) & 0xff) << 56;
+	gdt[(SEL_TSS >> 3) + 1] = base >> 32;
+
+	lgdt (&gdt_ds);
+	ltr (SEL_TSS);
+	intr_tss_update (thread_current ());
+}
+
+/* Makes NEXT, which is about to run on this CPU, the owner of
+   the CPU's double fault stack, so that thread_current() in the
+   double fault handler finds it.  tss_update() does this in
+   kernels with user programs. */
+void
+intr_tss_update (struct thread *next) {
+	struct task_state *tss = cpu_current ()->tss;
+
+	*kstack_owner (tss->ist1) = next;
+}
+#endif
+
 /* Returns true during processing of an external interrupt
    and false at all other times. */
 bool
 intr_context (void) {
-	return in_external_intr;
+	return cpu_current ()->in_external_intr;
 }
 
 /* During processing of an external interrupt, directs the
@@ -278,7 +470,7 @@ intr_context (void) {
 void
 intr_yield_on_return (void) {
 	ASSERT (intr_context ());  // 현재 인터럽트 컨텍스트인지 확인
-	yield_on_return = true;  // 인터럽트에서 반환할 때 양보하도록 설정
+	cpu_current ()->yield_on_return = true;  // 인터럽트에서 반환할 때 양보하도록 설정
 }
 
 /* 8259A Programmable Interrupt Controller. */
@@ -345,9 +537,16 @@ pic_end_of_interrupt (int irq) {
    FRAME은 인터럽트와 인터럽트된 스레드의 레지스터를 기술합니다. */
 void
 intr_handler (struct intr_frame *frame) {
+	struct cpu *c = cpu_current ();
 	bool external;
 	intr_handler_func *handler;
 
+	/* Code that had interrupts on did not hold the kernel lock.
+	   Interrupt gates turned them off, so take it now. */
+	if (intr_smp && (frame->eflags & FLAG_IF)
+			&& intr_get_level () == INTR_OFF)
+		spin_lock (&intr_lock);
+
 	/* External interrupts are special.
 	   We only handle one at a time (so interrupts must be off)
 	   and they need to be acknowledged on the PIC (see below).
@@ -356,13 +555,17 @@ intr_handler (struct intr_frame *frame) {
 	   한 번에 하나만 처리하며(따라서 인터럽트는 꺼져 있어야 함)
 	   PIC(프로그래머블 인터럽트 컨트롤러)에서 승인이 필요합니다(아래 참조).
 	   외부 인터럽트 핸들러는 잠들 수 없습니다. */
-	external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+	external = is_external (frame->vec_no);
 	if (external) {
 		ASSERT (intr_get_level () == INTR_OFF);
 		ASSERT (!intr_context ());
 
-		in_external_intr = true;
-		yield_on_return = false;
+		c->in_external_intr = true;
+		c->yield_on_return = false;
+
+		/* Catch up on ticks skipped by tickless idle before the
+		   handler looks at the clock. */
+		timer_idle_exit ();
 	}
 
 	/* Invoke the interrupt's handler. */
@@ -391,12 +594,21 @@ intr_handler (struct intr_frame *frame) {
 		ASSERT (intr_get_level () == INTR_OFF);
 		ASSERT (intr_context ());
 
-		in_external_intr = false;
-		pic_end_of_interrupt (frame->vec_no);
+		c->in_external_intr = false;
+		if (frame->vec_no < 0x30)
+			pic_end_of_interrupt (frame->vec_no);
+		else
+			lapic_eoi ();
 
-		if (yield_on_return)
+		/* The thread may come back on another CPU. */
+		if (c->yield_on_return)
 			thread_yield ();
 	}
+
+	/* Leave the kernel lock as the interrupted code expects it. */
+	if (intr_smp && (frame->eflags & FLAG_IF)
+			&& intr_get_level () == INTR_OFF)
+		spin_unlock (&intr_lock);
 }
 
 /* Dumps interrupt frame F to the console, for debugging. */
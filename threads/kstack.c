@@ -0,0 +1,126 @@
+#include "threads/kstack.h"
+#include <debug.h>
+#include <stddef.h>
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Kernel stacks live in an area of their own, KSTACK_AREA, rather
+   than in the kernel's direct map of physical memory, so that
+   their guard pages can simply be left unmapped.  The area lies
+   under the same top-level page table entry as the direct map,
+   which every pml4 shares (see pml4_create()), so a stack mapped
+   here is mapped in every address space at once.
+
+   Once a slot of the area has been mapped, its mapping never
+   changes: when its thread dies, the stack goes on a free list,
+   pages and all, for the next thread to reuse.  So no CPU can
+   hold a stale TLB entry for a kernel stack, and freeing one needs
+   no TLB shootdown.  The price is that stack pages are never given
+   back to the page allocator; the kernel keeps as many stacks as
+   it ever had threads at once. */
+
+#define KSTACK_AREA 0xff00000000        /* Base of kernel stack area. */
+#define KSTACK_SLOTS 1024               /* Number of stacks it holds. */
+
+/* Stacks of dead threads, linked through their owner slots. */
+static void *free_stacks;
+
+/* Serializes mapping new stacks. */
+static struct lock kstack_lock;
+
+/* Number of KSTACK_AREA slots mapped so far. */
+static size_t slots_used;
+
+/* Initializes the kernel stack allocator. */
+void
+kstack_init (void) {
+	lock_init (&kstack_lock);
+}
+
+/* Returns a free stack from the free list, or a null pointer if
+   there is none. */
+static void *
+reuse_stack (void) {
+	enum intr_level old_level = intr_disable ();
+	void *stack = free_stacks;
+
+	if (stack != NULL)
+		free_stacks = *kstack_owner ((uint64_t) stack);
+	intr_set_level (old_level);
+	return stack;
+}
+
+/* Maps a stack into a new slot of KSTACK_AREA and returns it, or
+   returns a null pointer if memory or slots run out. */
+static void *
+map_stack (void) {
+	void *pages[KSTACK_PAGES - 1];
+	uint8_t *stack = NULL;
+	int i;
+
+	for (i = 0; i < KSTACK_PAGES - 1; i++) {
+		pages[i] = palloc_get_page (0);
+		if (pages[i] == NULL)
+			goto done;
+	}
+
+	lock_acquire (&kstack_lock);
+	if (slots_used < KSTACK_SLOTS) {
+		stack = (uint8_t *) KSTACK_AREA + slots_used * KSTACK_SIZE;
+		for (i = 0; i < KSTACK_PAGES - 1; i++) {
+			uint64_t *pte = pml4e_walk (base_pml4,
+					(uint64_t) stack + (i + 1) * PGSIZE, 1);
+			if (pte == NULL) {
+				/* Pages mapped so far stay with the slot, which a
+				   later try may fill in. */
+				stack = NULL;
+				break;
+			}
+			*pte = vtop (pages[i]) | PTE_P | PTE_W;
+		}
+		if (stack != NULL)
+			slots_used++;
+	}
+	lock_release (&kstack_lock);
+
+done:
+	if (stack == NULL)
+		while (i-- > 0)
+			palloc_free_page (pages[i]);
+	return stack;
+}
+
+/* Returns a new kernel stack, or a null pointer if memory is
+   short.  The stack's contents are undefined. */
+void *
+kstack_alloc (void) {
+	void *stack = reuse_stack ();
+
+	return stack != NULL ? stack : map_stack ();
+}
+
+/* Frees kernel STACK, which must no longer be in use.  May be
+   called with interrupts off. */
+void
+kstack_free (void *stack) {
+	enum intr_level old_level;
+
+	ASSERT (stack != NULL);
+	ASSERT (((uint64_t) stack & (KSTACK_SIZE - 1)) == 0);
+
+	old_level = intr_disable ();
+	*kstack_owner ((uint64_t) stack) = free_stacks;
+	free_stacks = stack;
+	intr_set_level (old_level);
+}
+
+/* Returns true if ADDR lies in the guard page of kernel STACK. */
+bool
+kstack_in_guard (const void *stack, const void *addr) {
+	return stack != NULL && pg_round_down (addr) == stack;
+}
@@ -0,0 +1,182 @@
+#include "threads/lapic.h"
+#include <debug.h>
+#include "threads/init.h"
+#include "threads/mmu.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+/* Local APIC.
+
+   Each CPU has a local APIC, reached through a page of
+   memory-mapped registers at the same physical address on every
+   CPU; each CPU sees its own.  We use it to send and receive
+   inter-processor interrupts and, on CPUs other than the boot
+   CPU, as the timer.  Device interrupts keep arriving through the
+   8259A PICs, which the boot CPU's local APIC passes through in
+   "virtual wire" mode.  See [IA32-v3a] chapter 10 "Advanced
+   Programmable Interrupt Controller (APIC)". */
+
+/* Register offsets, in bytes. */
+#define LAPIC_ID     0x020      /* ID. */
+#define LAPIC_TPR    0x080      /* Task priority. */
+#define LAPIC_EOI    0x0b0      /* End of interrupt. */
+#define LAPIC_SVR    0x0f0      /* Spurious interrupt vector. */
+#define LAPIC_ESR    0x280      /* Error status. */
+#define LAPIC_ICRLO  0x300      /* Interrupt command, bits 0-31. */
+#define LAPIC_ICRHI  0x310      /* Interrupt command, bits 32-63. */
+#define LAPIC_TIMER  0x320      /* LVT timer. */
+#define LAPIC_LINT0  0x350      /* LVT local interrupt 0. */
+#define LAPIC_LINT1  0x360      /* LVT local interrupt 1. */
+#define LAPIC_ERROR  0x370      /* LVT error. */
+#define LAPIC_TICR   0x380      /* Timer initial count. */
+#define LAPIC_TCCR   0x390      /* Timer current count. */
+#define LAPIC_TDCR   0x3e0      /* Timer divide configuration. */
+
+/* Register bits. */
+#define SVR_ENABLE      0x00000100      /* Software enable. */
+#define LVT_MASKED      0x00010000      /* Interrupt masked. */
+#define LVT_PERIODIC    0x00020000      /* Timer: periodic mode. */
+#define LVT_EXTINT      0x00000700      /* Delivery mode: ExtINT. */
+#define LVT_NMI         0x00000400      /* Delivery mode: NMI. */
+#define ICR_FIXED       0x00000000      /* Delivery mode: fixed. */
+#define ICR_INIT        0x00000500      /* Delivery mode: INIT. */
+#define ICR_STARTUP     0x00000600      /* Delivery mode: start-up. */
+#define ICR_PENDING     0x00001000      /* Delivery status: send pending. */
+#define ICR_ASSERT      0x00004000      /* Level: assert. */
+#define ICR_LEVEL       0x00008000      /* Trigger mode: level. */
+#define TDCR_DIV16      0x3             /* Divide bus clock by 16. */
+
+/* Local APIC registers, or a null pointer if there is none. */
+static volatile uint32_t *lapic;
+
+/* Returns local APIC register REG. */
+static uint32_t
+lapic_read (int reg) {
+	return lapic[reg / 4];
+}
+
+/* Writes VALUE to local APIC register REG, then waits for the
+   write to complete by reading back the ID register. */
+static void
+lapic_write (int reg, uint32_t value) {
+	lapic[reg / 4] = value;
+	(void) lapic[LAPIC_ID / 4];
+}
+
+/* Maps the local APIC's registers, at physical address PADDR,
+   into the kernel's part of the address space.  The mapping is
+   uncached, as it must be for device registers.  Must be called
+   before any user page table is created, so that every page
+   table shares it. */
+void
+lapic_map (uint64_t paddr) {
+	uint64_t *pte;
+
+	ASSERT (pg_ofs (paddr) == 0);
+
+	pte = pml4e_walk (base_pml4, (uint64_t) ptov (paddr), 1);
+	ASSERT (pte != NULL);
+	*pte = paddr | PTE_P | PTE_W | PTE_PCD | PTE_PWT;
+	lapic = ptov (paddr);
+}
+
+/* Returns true if the local APIC has been found and mapped. */
+bool
+lapic_present (void) {
+	return lapic != NULL;
+}
+
+/* Enables the running CPU's local APIC.  On the boot CPU (BSP),
+   local interrupt 0 stays in virtual wire mode, so that the PICs'
+   interrupts still get through; other CPUs mask it. */
+void
+lapic_init (bool bsp) {
+	ASSERT (lapic != NULL);
+
+	lapic_write (LAPIC_SVR, SVR_ENABLE | LAPIC_VEC_SPURIOUS);
+	lapic_write (LAPIC_TIMER, LVT_MASKED | LAPIC_VEC_TIMER);
+	lapic_write (LAPIC_LINT0, bsp ? LVT_EXTINT : LVT_MASKED);
+	lapic_write (LAPIC_LINT1, LVT_NMI);
+	lapic_write (LAPIC_ERROR, LVT_MASKED);
+
+	/* Clear error status, which takes back-to-back writes, and any
+	   interrupt left in service. */
+	lapic_write (LAPIC_ESR, 0);
+	lapic_write (LAPIC_ESR, 0);
+	lapic_write (LAPIC_EOI, 0);
+
+	/* Accept interrupts of every priority. */
+	lapic_write (LAPIC_TPR, 0);
+}
+
+/* Returns the running CPU's local APIC ID. */
+uint8_t
+lapic_id (void) {
+	return lapic != NULL ? lapic_read (LAPIC_ID) >> 24 : 0;
+}
+
+/* Acknowledges the interrupt being handled on the running CPU. */
+void
+lapic_eoi (void) {
+	if (lapic != NULL)
+		lapic_write (LAPIC_EOI, 0);
+}
+
+/* Sends ICR_LO to the CPU whose local APIC ID is APIC_ID and
+   waits for the local APIC to accept it. */
+static void
+send_icr (uint8_t apic_id, uint32_t icr_lo) {
+	lapic_write (LAPIC_ICRHI, (uint32_t) apic_id << 24);
+	lapic_write (LAPIC_ICRLO, icr_lo);
+	while (lapic_read (LAPIC_ICRLO) & ICR_PENDING)
+		asm volatile ("pause");
+}
+
+/* Interrupts the CPU with local APIC ID APIC_ID with vector VEC. */
+void
+lapic_send_ipi (uint8_t apic_id, uint8_t vec) {
+	ASSERT (lapic != NULL);
+	send_icr (apic_id, ICR_FIXED | ICR_ASSERT | vec);
+}
+
+/* Starts the application processor with local APIC ID APIC_ID
+   running real-mode code at physical address PADDR, which must
+   be page-aligned and below 1 MB.  Follows the INIT-SIPI-SIPI
+   sequence of [MP] appendix B.4.  Sleeps, so it must be called
+   from a thread with interrupts on. */
+void
+lapic_start_ap (uint8_t apic_id, uint64_t paddr) {
+	ASSERT (lapic != NULL);
+	ASSERT (pg_ofs (paddr) == 0 && paddr < 0x100000);
+
+	send_icr (apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+	timer_usleep (200);
+	send_icr (apic_id, ICR_INIT | ICR_LEVEL);
+	timer_msleep (10);
+
+	for (int i = 0; i < 2; i++) {
+		send_icr (apic_id, ICR_STARTUP | (paddr >> 12));
+		timer_usleep (200);
+	}
+}
+
+/* Starts the running CPU's local timer counting down from COUNT,
+   in units of 16 bus clocks.  When the count reaches zero, the
+   timer raises VEC unless MASKED, and if PERIODIC starts over. */
+void
+lapic_timer_start (uint8_t vec, uint32_t count, bool periodic, bool masked) {
+	ASSERT (lapic != NULL);
+
+	lapic_write (LAPIC_TDCR, TDCR_DIV16);
+	lapic_write (LAPIC_TIMER, vec | (periodic ? LVT_PERIODIC : 0)
+			| (masked ? LVT_MASKED : 0));
+	lapic_write (LAPIC_TICR, count);
+}
+
+/* Returns the running CPU's local timer's current count. */
+uint32_t
+lapic_timer_current (void) {
+	ASSERT (lapic != NULL);
+	return lapic_read (LAPIC_TCCR);
+}
@@ -5,6 +5,8 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
+#include "threads/mp.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -32,7 +34,21 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   In front of each descriptor's free list, each CPU keeps a
+   "magazine" of up to MAG_SIZE free blocks of that size, which
+   only it touches, with interrupts off.  Most malloc() and free()
+   calls take a block from or put one in the running CPU's
+   magazine, without taking the descriptor's lock.  With more than
+   one CPU that still takes the kernel lock (see interrupt.c), so
+   magazines save the cost of the descriptor's lock but do not let
+   CPUs allocate in parallel.  An empty
+   magazine is refilled, and a full one is half emptied, in
+   batches of MAG_BATCH blocks under the lock.  Blocks in
+   magazines count as in use as far as their arenas are
+   concerned, so a few arenas may stay around that would
+   otherwise be freed.  See [Bonwick01] for the idea. */
 
 /* Descriptor. */
 struct desc {
@@ -58,11 +74,33 @@ struct block {
 };
 
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
-static size_t desc_cnt;         /* Number of descriptors. */
+#define DESC_MAX 10
+static struct desc descs[DESC_MAX];     /* Descriptors. */
+static size_t desc_cnt;                 /* Number of descriptors. */
+
+/* A CPU's cache of free blocks of one descriptor's size. */
+#define MAG_SIZE 16             /* Most blocks in a magazine. */
+#define MAG_BATCH 8             /* Blocks moved per refill or flush. */
+struct magazine {
+	size_t cnt;                 /* Number of blocks. */
+	struct block *blocks[MAG_SIZE];     /* Blocks, last in first out. */
+};
+
+/* Magazines, by CPU and descriptor. */
+static struct magazine magazines[CPU_MAX][DESC_MAX];
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static size_t get_blocks (struct desc *, struct block *[], size_t cnt);
+static void put_blocks (struct desc *, struct block *[], size_t cnt);
+
+/* Returns the running CPU's magazine for descriptor D.  Must be
+   called with interrupts off. */
+static struct magazine *
+cpu_magazine (struct desc *d) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	return &magazines[cpu_current ()->id][d - descs];
+}
 
 /* Initializes the malloc() descriptors. */
 void
@@ -71,11 +109,14 @@ malloc_init (void) {
 
 	for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2) {
 		struct desc *d = &descs[desc_cnt++];
-		ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+		ASSERT (desc_cnt <= DESC_MAX);
 		d->block_size = block_size;
 		d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
 		list_init (&d->free_list);
 		lock_init (&d->lock);
+		/* Held only to move a batch of blocks to or from a
+		   magazine, so spinning beats sleeping. */
+		lock_set_adaptive (&d->lock, true);
 	}
 }
 
@@ -86,6 +127,10 @@ malloc (size_t size) {
 	struct desc *d;
 	struct block *b;
 	struct arena *a;
+	struct magazine *m;
+	struct block *batch[MAG_BATCH];
+	enum intr_level old_level;
+	size_t cnt, i;
 
 	/* A null pointer satisfies a request for 0 bytes. */
 	if (size == 0)
@@ -112,35 +157,71 @@ malloc (size_t size) {
 		return a + 1;
 	}
 
-	lock_acquire (&d->lock);
+	/* Take a block from this CPU's magazine, if it has one. */
+	old_level = intr_disable ();
+	m = cpu_magazine (d);
+	if (m->cnt > 0) {
+		b = m->blocks[--m->cnt];
+		intr_set_level (old_level);
+		return b;
+	}
+	intr_set_level (old_level);
 
-	/* If the free list is empty, create a new arena. */
-	if (list_empty (&d->free_list)) {
-		size_t i;
+	/* Otherwise get a batch from the free list, return one block,
+	   and put the rest in the magazine of whatever CPU we are on
+	   by now. */
+	cnt = get_blocks (d, batch, MAG_BATCH);
+	if (cnt == 0)
+		return NULL;
+	old_level = intr_disable ();
+	m = cpu_magazine (d);
+	for (i = 1; i < cnt && m->cnt < MAG_SIZE; i++)
+		m->blocks[m->cnt++] = batch[i];
+	intr_set_level (old_level);
+	if (i < cnt)
+		put_blocks (d, batch + i, cnt - i);
+	return batch[0];
+}
 
-		/* Allocate a page. */
-		a = palloc_get_page (0);
-		if (a == NULL) {
-			lock_release (&d->lock);
-			return NULL;
-		}
+/* Takes up to CNT blocks from D's free list, creating an arena if
+   the list is empty, and stores them in BLOCKS.  Returns the number
+   of blocks taken, which is 0 only if memory is short. */
+static size_t
+get_blocks (struct desc *d, struct block *blocks[], size_t cnt) {
+	size_t taken = 0;
 
-		/* Initialize arena and add its blocks to the free list. */
-		a->magic = ARENA_MAGIC;
-		a->desc = d;
-		a->free_cnt = d->blocks_per_arena;
-		for (i = 0; i < d->blocks_per_arena; i++) {
-			struct block *b = arena_to_block (a, i);
-			list_push_back (&d->free_list, &b->free_elem);
+	lock_acquire (&d->lock);
+	while (taken < cnt) {
+		struct block *b;
+		struct arena *a;
+
+		/* If the free list is empty, create a new arena. */
+		if (list_empty (&d->free_list)) {
+			size_t i;
+
+			/* Allocate a page. */
+			a = palloc_get_page (0);
+			if (a == NULL)
+				break;
+
+			/* Initialize arena and add its blocks to the free list. */
+			a->magic = ARENA_MAGIC;
+			a->desc = d;
+			a->free_cnt = d->blocks_per_arena;
+			for (i = 0; i < d->blocks_per_arena; i++) {
+				b = arena_to_block (a, i);
+				list_push_back (&d->free_list, &b->free_elem);
+			}
 		}
-	}
 
-	/* Get a block from free list and return it. */
-	b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-	a = block_to_arena (b);
-	a->free_cnt--;
+		/* Get a block from free list. */
+		b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+		a = block_to_arena (b);
+		a->free_cnt--;
+		blocks[taken++] = b;
+	}
 	lock_release (&d->lock);
-	return b;
+	return taken;
 }
 
 /* Allocates and return A times B bytes initialized to zeroes.
@@ -207,30 +288,31 @@ free (void *p) {
 
 		if (d != NULL) {
 			/* It's a normal block.  We handle it here. */
+			struct block *batch[MAG_BATCH + 1];
+			struct magazine *m;
+			enum intr_level old_level;
+			size_t i;
 
 #ifndef NDEBUG
 			/* Clear the block to help detect use-after-free bugs. */
 			memset (b, 0xcc, d->block_size);
 #endif
 
-			lock_acquire (&d->lock);
-
-			/* Add block to free list. */
-			list_push_front (&d->free_list, &b->free_elem);
-
-			/* If the arena is now entirely unused, free it. */
-			if (++a->free_cnt >= d->blocks_per_arena) {
-				size_t i;
-
-				ASSERT (a->free_cnt == d->blocks_per_arena);
-				for (i = 0; i < d->blocks_per_arena; i++) {
-					struct block *b = arena_to_block (a, i);
-					list_remove (&b->free_elem);
-				}
-				palloc_free_page (a);
+			/* Put the block in this CPU's magazine.  If that is
+			   full, return the block and a batch of the magazine's
+			   blocks to the free list. */
+			old_level = intr_disable ();
+			m = cpu_magazine (d);
+			if (m->cnt < MAG_SIZE) {
+				m->blocks[m->cnt++] = b;
+				intr_set_level (old_level);
+				return;
 			}
-
-			lock_release (&d->lock);
+			for (i = 0; i < MAG_BATCH; i++)
+				batch[i] = m->blocks[--m->cnt];
+			intr_set_level (old_level);
+			batch[MAG_BATCH] = b;
+			put_blocks (d, batch, MAG_BATCH + 1);
 		} else {
 			/* It's a big block.  Free its pages. */
 			palloc_free_multiple (a, a->free_cnt);
@@ -239,6 +321,35 @@ free (void *p) {
 	}
 }
 
+/* Returns the CNT blocks in BLOCKS to D's free list, freeing
+   any arena that is left entirely unused. */
+static void
+put_blocks (struct desc *d, struct block *blocks[], size_t cnt) {
+	size_t i;
+
+	lock_acquire (&d->lock);
+	for (i = 0; i < cnt; i++) {
+		struct block *b = blocks[i];
+		struct arena *a = block_to_arena (b);
+
+		/* Add block to free list. */
+		list_push_front (&d->free_list, &b->free_elem);
+
+		/* If the arena is now entirely unused, free it. */
+		if (++a->free_cnt >= d->blocks_per_arena) {
+			size_t j;
+
+			ASSERT (a->free_cnt == d->blocks_per_arena);
+			for (j = 0; j < d->blocks_per_arena; j++) {
+				struct block *b = arena_to_block (a, j);
+				list_remove (&b->free_elem);
+			}
+			palloc_free_page (a);
+		}
+	}
+	lock_release (&d->lock);
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b) {
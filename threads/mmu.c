@@ -1,19 +1,51 @@
+#include <debug.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/mp.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+static void pcid_forget (uint64_t *pml4, struct cpu *keep);
+
+/* Replaces *PDE, which maps a 2 MB page, by a page table that
+ * maps the same memory in 4 kB pages with the same permissions.
+ * The translation does not change, so any TLB entry for the old
+ * mapping stays correct and need not be flushed.  Returns false
+ * if memory allocation failed. */
+static bool
+split_pde (uint64_t *pde) {
+	uint64_t *pt = palloc_get_page (0);
+	uint64_t pa = PTE_ADDR (*pde);
+	uint64_t flags = *pde & PTE_FLAGS & ~PTE_PS;
+
+	if (pt == NULL)
+		return false;
+	for (unsigned i = 0; i < PGSIZE / sizeof (uint64_t); i++)
+		pt[i] = (pa + i * PGSIZE) | flags;
+	*pde = vtop (pt) | PTE_U | PTE_W | PTE_P;
+	return true;
+}
+
+/* If the PDE for VA maps a 2 MB page, returns the PDE itself,
+ * with PTE_PS set, unless CREATE is true, in which case the 2 MB
+ * page is first split into 4 kB pages. */
 static uint64_t *
 pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
 	if (pdp) {
 		uint64_t *pte = (uint64_t *) pdp[idx];
-		if (!((uint64_t) pte & PTE_P)) {
+		if ((uint64_t) pte & PTE_PS) {
+			if (!create)
+				return &pdp[idx];
+			if (!split_pde (&pdp[idx]))
+				return NULL;
+		} else if (!((uint64_t) pte & PTE_P)) {
 			if (create) {
 				uint64_t *new_page = palloc_get_page (PAL_ZERO);
 				if (new_page)
@@ -88,6 +120,38 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	return pte;
 }
 
+/* Returns the page table at index IDX of the next level up
+ * TABLE, creating it if it does not exist and CREATE is true, or
+ * a null pointer. */
+static uint64_t *
+next_table (uint64_t *table, int idx, int create) {
+	if (!(table[idx] & PTE_P)) {
+		uint64_t *new_page;
+
+		if (!create || (new_page = palloc_get_page (PAL_ZERO)) == NULL)
+			return NULL;
+		table[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+	}
+	return ptov (PTE_ADDR (table[idx]));
+}
+
+/* Returns the address of the page directory entry for virtual
+ * address VA in PML4, for mapping a 2 MB page.  If PML4 has no
+ * page directory for VA, behavior depends on CREATE, as in
+ * pml4e_walk(). */
+uint64_t *
+pml4_pde_walk (uint64_t *pml4, const uint64_t va, int create) {
+	uint64_t *pdp, *pd;
+
+	pdp = next_table (pml4, PML4 (va), create);
+	if (pdp == NULL)
+		return NULL;
+	pd = next_table (pdp, PDPE (va), create);
+	if (pd == NULL)
+		return NULL;
+	return &pd[PDX (va)];
+}
+
 /* Creates a new page map level 4 (pml4) has mappings for kernel
  * virtual addresses, but none for user virtual addresses.
  * Returns the new page directory, or a null pointer if memory
@@ -122,7 +186,13 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		if (pdp[i] & PTE_PS) {
+			void *va = (void *) (((uint64_t) pml4_index << PML4SHIFT) |
+								 ((uint64_t) pdp_index << PDPESHIFT) |
+								 ((uint64_t) i << PDXSHIFT));
+			if (!func (&pdp[i], va, aux))
+				return false;
+		} else if (((uint64_t) pte) & PTE_P)
 			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
 					pml4_index, pdp_index, i))
 				return false;
@@ -143,7 +213,8 @@ pdp_for_each (uint64_t *pdp,
 	return true;
 }
 
-/* Apply FUNC to each available pte entries including kernel's. */
+/* Apply FUNC to each available pte entries including kernel's.
+ * A PDE that maps a 2 MB page is passed as is, with PTE_PS set. */
 bool
 pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
@@ -169,7 +240,10 @@ static void
 pgdir_destroy (uint64_t *pdp) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		if (pdp[i] & PTE_PS)
+			palloc_free_multiple ((void *) PTE_ADDR (pte),
+					HUGE_PGSIZE / PGSIZE);
+		else if (((uint64_t) pte) & PTE_P)
 			pt_destroy (PTE_ADDR (pte));
 	}
 	palloc_free_page ((void *) pdp);
@@ -196,14 +270,141 @@ pml4_destroy (uint64_t *pml4) {
 	uint64_t *pdpe = ptov ((uint64_t *) pml4[0]);
 	if (((uint64_t) pdpe) & PTE_P)
 		pdpe_destroy ((void *) PTE_ADDR (pdpe));
+	pcid_forget (pml4, NULL);
 	palloc_free_page ((void *) pml4);
 }
 
+/* Address space switches.
+
+   Each CPU remembers which pml4 it has loaded, so that switching
+   between two threads of the same address space, including
+   between kernel threads, which all run on base_pml4, does not
+   touch CR3 at all.
+
+   Where the CPU has process-context identifiers (PCIDs), TLB
+   entries are tagged with the PCID in CR3, and a CR3 load with
+   CR3_NOFLUSH set keeps the entries of every PCID.  Each CPU then
+   hands out PCIDs 1...PCID_SLOTS to the pml4s it most recently
+   loaded, round-robin, and base_pml4 always has PCID 0.  Loading
+   a pml4 that still has its PCID keeps its TLB entries; taking a
+   PCID for a new pml4 flushes the entries it had.  A pml4 that
+   changes while not loaded, or is destroyed, gives up its PCIDs,
+   so that the next load starts clean. */
+
+#define CR4_PCIDE (1 << 17)             /* PCIDs enabled. */
+#define CR3_NOFLUSH (1ULL << 63)        /* Keep the PCID's TLB entries. */
+#define CPUID_1_ECX_PCID (1 << 17)      /* PCIDs supported. */
+
+/* True if every CPU uses PCIDs. */
+static bool pcid_enabled;
+
+/* Enables PCIDs on the running CPU, if the boot CPU has them.  Must
+ * be called on every CPU with base_pml4 loaded, on the boot CPU
+ * before any other. */
+void
+mmu_init_cpu (void) {
+	struct cpu *c = cpu_current ();
+
+	if (c == &cpus[0]) {
+		uint32_t eax = 1, ebx, ecx = 0, edx;
+
+		asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "+c" (ecx), "=d" (edx));
+		pcid_enabled = (ecx & CPUID_1_ECX_PCID) != 0;
+	}
+	if (pcid_enabled)
+		lcr4 (rcr4 () | CR4_PCIDE);
+	c->pml4 = base_pml4;
+}
+
+/* Returns the value to load into CR3 to activate PML4 on CPU C,
+ * which uses PCIDs, assigning PML4 a PCID if it has none. */
+static uint64_t
+pcid_cr3 (struct cpu *c, uint64_t *pml4) {
+	int slot;
+
+	if (pml4 == base_pml4)
+		return vtop (pml4) | CR3_NOFLUSH;
+	for (slot = 0; slot < PCID_SLOTS; slot++)
+		if (c->pcid_pml4[slot] == pml4)
+			return vtop (pml4) | (slot + 1) | CR3_NOFLUSH;
+
+	slot = c->pcid_next;
+	c->pcid_next = (slot + 1) % PCID_SLOTS;
+	c->pcid_pml4[slot] = pml4;
+	return vtop (pml4) | (slot + 1);
+}
+
+/* Takes away any PCID that any CPU other than KEEP, which may be
+ * null, gave PML4. */
+static void
+pcid_forget (uint64_t *pml4, struct cpu *keep) {
+	enum intr_level old_level;
+
+	if (!pcid_enabled)
+		return;
+
+	old_level = intr_disable ();
+	for (int i = 0; i < cpu_cnt; i++)
+		for (int slot = 0; slot < PCID_SLOTS; slot++)
+			if (&cpus[i] != keep && cpus[i].pcid_pml4[slot] == pml4)
+				cpus[i].pcid_pml4[slot] = NULL;
+	intr_set_level (old_level);
+}
+
+/* Returns true if PML4 is loaded on the running CPU. */
+static bool
+pml4_is_active (uint64_t *pml4) {
+	return PTE_ADDR (rcr3 ()) == vtop (pml4);
+}
+
+/* Returns true if PML4 is loaded on a CPU other than the running
+ * one, whose TLB may then hold any of its entries.  Must be called
+ * with interrupts off, and the answer holds only as long as they
+ * stay off. */
+bool
+pml4_is_loaded_elsewhere (uint64_t *pml4) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (int i = 0; i < cpu_cnt; i++)
+		if (&cpus[i] != cpu_current () && cpus[i].pml4 == pml4)
+			return true;
+	return false;
+}
+
+/* Drops any TLB entry for virtual page VA of PML4, which has just
+ * changed.  Other CPUs may still hold entries for VA under the
+ * PCID they gave PML4 when it last ran there, so they lose that
+ * PCID even if PML4 is loaded here.  A CPU that has PML4 loaded
+ * right now is not reached; callers must not change a page table
+ * that is live on another CPU. */
+static void
+pml4_invalidate (uint64_t *pml4, const void *va) {
+	enum intr_level old_level = intr_disable ();
+
+	if (pml4_is_active (pml4)) {
+		invlpg ((uint64_t) va);
+		pcid_forget (pml4, cpu_current ());
+	} else
+		pcid_forget (pml4, NULL);
+	intr_set_level (old_level);
+}
+
 /* Loads page directory PD into the CPU's page directory base
- * register. */
+ * register, unless it is already there. */
 void
 pml4_activate (uint64_t *pml4) {
-	lcr3 (vtop (pml4 ? pml4 : base_pml4));
+	struct cpu *c = cpu_current ();
+	enum intr_level old_level;
+
+	if (pml4 == NULL)
+		pml4 = base_pml4;
+
+	old_level = intr_disable ();
+	if (c->pml4 != pml4) {
+		c->pml4 = pml4;
+		lcr3 (pcid_enabled ? pcid_cr3 (c, pml4) : vtop (pml4));
+	}
+	intr_set_level (old_level);
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -216,6 +417,8 @@ pml4_get_page (uint64_t *pml4, const void *uaddr) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
 
+	if (pte && (*pte & PTE_PS))
+		return ptov (PTE_ADDR (*pte)) + ((uint64_t) uaddr & (HUGE_PGSIZE - 1));
 	if (pte && (*pte & PTE_P))
 		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
 	return NULL;
@@ -243,23 +446,100 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 	return pte != NULL;
 }
 
+/* Number of 2 MB user pages split into 4 kB pages. */
+uint64_t huge_split_cnt;
+
+/* Maps the 2 MB of user virtual memory at UPAGE to the 2 MB of
+ * physical memory at kernel virtual address KPAGE, with one PDE.
+ * Both must be aligned on 2 MB.  No page in the range may be
+ * mapped already; a page table left over from earlier mappings
+ * is freed.  KPAGE should be a block obtained with
+ * palloc_get_multiple(PAL_USER, HUGE_PGSIZE / PGSIZE), whose
+ * blocks are aligned to their size.  Returns true if successful,
+ * false if memory allocation failed or a page was mapped. */
+bool
+pml4_set_huge_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
+	uint64_t *pde, *pt;
+
+	ASSERT ((uint64_t) upage % HUGE_PGSIZE == 0);
+	ASSERT (vtop (kpage) % HUGE_PGSIZE == 0);
+	ASSERT (is_user_vaddr (upage));
+	ASSERT (pml4 != base_pml4);
+
+	pde = pml4_pde_walk (pml4, (uint64_t) upage, 1);
+	if (pde == NULL || (*pde & PTE_PS))
+		return false;
+	if (*pde & PTE_P) {
+		pt = ptov (PTE_ADDR (*pde));
+		for (unsigned i = 0; i < PGSIZE / sizeof (uint64_t); i++)
+			if (pt[i] & PTE_P)
+				return false;
+		*pde = 0;
+		/* Drop any cached pointer to the old page table. */
+		pml4_invalidate (pml4, upage);
+		palloc_free_page (pt);
+	}
+	*pde = vtop (kpage) | PTE_P | (rw ? PTE_W : 0) | PTE_U | PTE_PS;
+	return true;
+}
+
+/* If UPAGE lies in a 2 MB page of PML4, remaps that page as 512
+ * 4 kB pages, so that they can be changed one by one.  Returns
+ * false if memory allocation failed. */
+bool
+pml4_split_huge_page (uint64_t *pml4, void *upage) {
+	uint64_t *pde;
+
+	ASSERT (is_user_vaddr (upage));
+
+	pde = pml4_pde_walk (pml4, (uint64_t) upage, 0);
+	if (pde == NULL || !(*pde & PTE_PS))
+		return true;
+	if (!split_pde (pde))
+		return false;
+	huge_split_cnt++;
+	return true;
+}
+
+/* If UPAGE lies in a 2 MB page of PML4, unmaps all of that page at
+ * once, without splitting it, and returns true.  Returns false if
+ * UPAGE is not in a 2 MB page.  Meant for tearing down an address
+ * space, when every page in the 2 MB is about to go anyway. */
+bool
+pml4_clear_huge_page (uint64_t *pml4, void *upage) {
+	uint64_t *pde;
+
+	ASSERT (is_user_vaddr (upage));
+
+	pde = pml4_pde_walk (pml4, (uint64_t) upage, 0);
+	if (pde == NULL || !(*pde & PTE_PS))
+		return false;
+	*pde = 0;
+	pml4_invalidate (pml4, upage);
+	return true;
+}
+
 /* Marks user virtual page UPAGE "not present" in page
  * directory PD.  Later accesses to the page will fault.  Other
- * bits in the page table entry are preserved.
- * UPAGE need not be mapped. */
-void
+ * bits in the page table entry are preserved.  If UPAGE lies in
+ * a 2 MB page, the rest of that page stays mapped, in 4 kB pages.
+ * UPAGE need not be mapped.  Returns false, leaving the mapping
+ * as it was, if splitting a 2 MB page ran out of memory. */
+bool
 pml4_clear_page (uint64_t *pml4, void *upage) {
 	uint64_t *pte;
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (is_user_vaddr (upage));
 
+	if (!pml4_split_huge_page (pml4, upage))
+		return false;
 	pte = pml4e_walk (pml4, (uint64_t) upage, false);
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
 		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) upage);
+		pml4_invalidate (pml4, upage);
 	}
+	return true;
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PML4 is dirty,
@@ -281,10 +561,9 @@ pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
 		if (dirty)
 			*pte |= PTE_D;
 		else
-			*pte &= ~(uint32_t) PTE_D;
+			*pte &= ~(uint64_t) PTE_D;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		pml4_invalidate (pml4, vpage);
 	}
 }
 
@@ -307,9 +586,8 @@ pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
 		if (accessed)
 			*pte |= PTE_A;
 		else
-			*pte &= ~(uint32_t) PTE_A;
+			*pte &= ~(uint64_t) PTE_A;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		pml4_invalidate (pml4, vpage);
 	}
 }
@@ -0,0 +1,276 @@
+#include "threads/mp.h"
+#include <debug.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/kstack.h"
+#include "threads/lapic.h"
+#include "threads/loader.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+#include "intrinsic.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/syscall.h"
+#endif
+
+/* Multiprocessor support.
+
+   The boot CPU (BSP) finds the other CPUs, the application
+   processors (APs), in the MP configuration table that the BIOS
+   leaves in low memory [MP].  After the scheduler and the timer
+   are up, mp_start_aps() wakes each AP with the start-up code in
+   mpentry.S, which switches it to long mode and calls
+   mp_ap_main() on a thread of its own.  From then on the AP runs
+   threads from its own run queue.
+
+   Kernel code that runs with interrupts off is serialized across
+   CPUs by the kernel lock in interrupt.c, so the rest of the
+   kernel does not need to know how many CPUs there are.  That
+   includes the run queues, the timer, the page allocator, and
+   semaphore wait lists, none of which has a lock of its own, so
+   only code that runs with interrupts on actually runs on more
+   than one CPU at a time.  Device interrupts still all go to the
+   boot CPU through the 8259s; the I/O APIC is not used. */
+
+/* Every CPU, the boot CPU first. */
+struct cpu cpus[CPU_MAX];
+
+/* Number of CPUs in cpus[]. */
+int cpu_cnt = 1;
+
+/* MP floating pointer structure.  See [MP] 4.1. */
+struct mp_fps {
+	char signature[4];          /* "_MP_". */
+	uint32_t config;            /* Physical address of mp_config. */
+	uint8_t length;             /* Length in 16-byte units. */
+	uint8_t spec_rev;           /* Version of [MP]. */
+	uint8_t checksum;           /* All bytes add to 0. */
+	uint8_t type;               /* Default configuration type. */
+	uint8_t imcr;               /* Bit 7: IMCR present. */
+	uint8_t reserved[3];
+} __attribute__ ((packed));
+
+/* MP configuration table header.  See [MP] 4.2. */
+struct mp_config {
+	char signature[4];          /* "PCMP". */
+	uint16_t length;            /* Length of base table. */
+	uint8_t version;            /* Version of [MP]. */
+	uint8_t checksum;           /* All bytes add to 0. */
+	char product[20];           /* Product ID. */
+	uint32_t oem_table;         /* OEM table pointer. */
+	uint16_t oem_length;        /* OEM table length. */
+	uint16_t entry_cnt;         /* Number of entries. */
+	uint32_t lapic;             /* Physical address of local APICs. */
+	uint16_t ext_length;        /* Extended table length. */
+	uint8_t ext_checksum;       /* Extended table checksum. */
+	uint8_t reserved;
+} __attribute__ ((packed));
+
+/* MP configuration table processor entry.  See [MP] 4.3.1. */
+struct mp_proc {
+	uint8_t type;               /* MP_PROC. */
+	uint8_t apic_id;            /* Local APIC ID. */
+	uint8_t version;            /* Local APIC version. */
+	uint8_t flags;              /* MP_PROC_*. */
+	uint32_t signature;         /* CPU signature. */
+	uint32_t features;          /* CPUID feature flags. */
+	uint8_t reserved[8];
+} __attribute__ ((packed));
+
+/* MP configuration table entry types. */
+#define MP_PROC    0x00         /* Processor, 20 bytes. */
+#define MP_BUS     0x01         /* Bus, 8 bytes. */
+#define MP_IOAPIC  0x02         /* I/O APIC, 8 bytes. */
+#define MP_IOINTR  0x03         /* I/O interrupt assignment, 8 bytes. */
+#define MP_LINTR   0x04         /* Local interrupt assignment, 8 bytes. */
+
+/* Processor entry flags. */
+#define MP_PROC_ENABLED 0x01    /* Usable. */
+#define MP_PROC_BSP     0x02    /* Boot processor. */
+
+/* Defined in mpentry.S. */
+extern char mpentry_start[], mpentry_end[];
+extern uint64_t mpentry_cr3, mpentry_stack;
+
+void mp_ap_main (void) NO_RETURN;
+
+/* Returns the sum of the SIZE bytes at P. */
+static uint8_t
+checksum (const void *p, size_t size) {
+	const uint8_t *bytes = p;
+	uint8_t sum = 0;
+
+	while (size-- > 0)
+		sum += *bytes++;
+	return sum;
+}
+
+/* Looks for an MP floating pointer structure in the SIZE bytes of
+   physical memory at PADDR. */
+static struct mp_fps *
+search_fps (uint64_t paddr, size_t size) {
+	struct mp_fps *fps = ptov (paddr);
+	struct mp_fps *end = ptov (paddr + size);
+
+	for (; fps < end; fps++)
+		if (!memcmp (fps->signature, "_MP_", 4)
+				&& checksum (fps, sizeof *fps) == 0)
+			return fps;
+	return NULL;
+}
+
+/* Finds the MP configuration table, which [MP] 4 says is pointed
+   to by a floating pointer structure in the first kB of the
+   extended BIOS data area, in the last kB of base memory, or in
+   the BIOS ROM between 0xf0000 and 0xfffff.  Returns a null
+   pointer if there is none, in which case we are a uniprocessor. */
+static struct mp_config *
+find_config (void) {
+	uint64_t ebda = (uint64_t) *(uint16_t *) ptov (0x40e) << 4;
+	uint64_t base_kb = *(uint16_t *) ptov (0x413);
+	struct mp_fps *fps = NULL;
+	struct mp_config *conf;
+
+	if (ebda != 0)
+		fps = search_fps (ebda, 1024);
+	if (fps == NULL)
+		fps = search_fps (base_kb * 1024 - 1024, 1024);
+	if (fps == NULL)
+		fps = search_fps (0xf0000, 0x10000);
+	if (fps == NULL || fps->config == 0)
+		return NULL;
+
+	conf = ptov (fps->config);
+	if (memcmp (conf->signature, "PCMP", 4)
+			|| (conf->version != 1 && conf->version != 4)
+			|| checksum (conf, conf->length) != 0)
+		return NULL;
+	return conf;
+}
+
+/* Finds the CPUs in the machine and enables the boot CPU's local
+   APIC.  Must be called after paging_init() and before any other
+   CPU-dependent initialization. */
+void
+mp_init (void) {
+	struct mp_config *conf;
+	uint8_t *p, *end;
+	uint8_t bsp_id;
+	int i;
+
+	for (i = 0; i < CPU_MAX; i++)
+		cpus[i].id = i;
+
+	conf = find_config ();
+	if (conf == NULL)
+		return;
+
+	lapic_map (conf->lapic);
+	lapic_init (true);
+	bsp_id = lapic_id ();
+	cpus[0].apic_id = bsp_id;
+
+	p = (uint8_t *) (conf + 1);
+	end = (uint8_t *) conf + conf->length;
+	while (p < end) {
+		struct mp_proc *proc;
+
+		switch (*p) {
+			case MP_PROC:
+				proc = (struct mp_proc *) p;
+				if ((proc->flags & MP_PROC_ENABLED) && proc->apic_id != bsp_id) {
+					if (cpu_cnt < CPU_MAX)
+						cpus[cpu_cnt++].apic_id = proc->apic_id;
+					else
+						printf ("mp: ignoring CPU with APIC ID %d\n", proc->apic_id);
+				}
+				p += sizeof *proc;
+				break;
+			case MP_BUS:
+			case MP_IOAPIC:
+			case MP_IOINTR:
+			case MP_LINTR:
+				/* Device interrupts stay on the PICs, so the I/O APIC
+				   and the interrupt routing entries are unused. */
+				p += 8;
+				break;
+			default:
+				printf ("mp: unknown configuration entry type %d\n", *p);
+				p = end;
+				break;
+		}
+	}
+
+	if (cpu_cnt > 1)
+		printf ("mp: %d CPUs\n", cpu_cnt);
+}
+
+/* Starts every application processor found by mp_init(), one at
+   a time.  Must be called from a thread, with interrupts on, once
+   the timer is calibrated. */
+void
+mp_start_aps (void) {
+	int i;
+
+	ASSERT (intr_get_level () == INTR_ON);
+
+	if (cpu_cnt == 1)
+		return;
+
+	timer_lapic_calibrate ();
+
+	/* The start-up code must be in the first megabyte, where a
+	   processor in real mode can reach it. */
+	memcpy (ptov (MPENTRY_PADDR), mpentry_start, mpentry_end - mpentry_start);
+	mpentry_cr3 = vtop (base_pml4);
+	intr_start_smp ();
+
+	for (i = 1; i < cpu_cnt; i++) {
+		struct cpu *c = &cpus[i];
+		struct thread *t = thread_init_ap (c);
+		int64_t start;
+
+		if (t == NULL)
+			break;
+		mpentry_stack = KSTACK_TOP (t->stack);
+		lapic_start_ap (c->apic_id, MPENTRY_PADDR);
+
+		start = timer_ticks ();
+		while (!c->started && timer_elapsed (start) < TIMER_FREQ)
+			barrier ();
+		if (!c->started) {
+			/* It may still wake up later, so the start-up code and
+			   its stack must stay as they are. */
+			printf ("mp: CPU %d (APIC ID %d) did not start\n", i, c->apic_id);
+			break;
+		}
+	}
+	cpu_cnt = i;
+}
+
+/* Entered from mpentry.S in long mode, on the thread that
+   thread_init_ap() made for this CPU, with interrupts off.  Sets
+   up this CPU's descriptor tables, local APIC, and timer, then
+   becomes its idle thread. */
+void
+mp_ap_main (void) {
+	intr_init_ap ();
+	mmu_init_cpu ();
+
+#ifdef USERPROG
+	gdt_init ();
+	ltr (SEL_TSS);
+	syscall_init_cpu ();
+#endif
+
+	lapic_init (false);
+	timer_lapic_start ();
+	thread_start_ap ();
+	NOT_REACHED ();
+}
@@ -2,14 +2,17 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -24,24 +27,155 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+   The -up boot option changes the user pool's share.  With the
+   -dynpool option, a pool that runs out borrows free pages from
+   the other: the kernel pool whenever it has to, the user pool
+   only while the kernel pool stays above its high watermark.  A
+   borrowed page goes back to the pool it came from when freed.
+
+   Each pool has low and high watermarks of free pages.  When a
+   pool's free pages fall below its low watermark, the "low"
+   callbacks of every palloc_watcher registered for it are called,
+   and when they come back up to its high watermark, the "high"
+   callbacks are.  A kernel thread makes the calls, so callbacks
+   may take locks and allocate memory.
+
+   Each pool is managed as a binary buddy system.  Free memory is
+   kept as blocks of 2**ORDER pages, for ORDER from 0 to
+   MAX_ORDER, each aligned in physical memory to its own size, on
+   one free list per order.  An allocation takes a block from the
+   smallest order that has one, splitting it in halves as needed,
+   and gives back any pages beyond the request.  A freed block
+   merges with its "buddy", the other half of the block of the
+   next order up, for as long as the buddy is free too.  Both take
+   O(MAX_ORDER) steps regardless of pool size or fragmentation.
+
+   The pools are protected by turning interrupts off, which also
+   keeps other CPUs out (see interrupt.c), rather than by a lock,
+   so that pages may be freed from within the scheduler.
+
+   Single pages, by far the most common request, mostly bypass the
+   buddy system.  Each pool keeps a stack of up to STACK_MAX freed
+   single pages, which palloc_get_page() pops in O(1).  Each pool
+   also keeps a list of up to ZERO_MAX free pages that are known to
+   be all zeros, which serves PAL_ZERO requests without a memset().
+   A low-priority kernel thread refills it whenever it falls to
+   ZERO_LOW, so that pages are mostly zeroed when the CPU would
+   otherwise be idle.  Pages on either list still count as free;
+   larger requests take them back into the buddy system when they
+   would otherwise fail.
+
+   Unless NDEBUG is defined, each pool also keeps a bitmap of its
+   used pages, which is only used to check the buddy system's
+   work. */
+
+/* Largest block order: 2**MAX_ORDER pages, that is, 1 GB. */
+#define MAX_ORDER 18
+
+/* Marks the first page of a free block in a pool's orders[]. */
+#define BLOCK_FREE 0x80
+
+/* Most single pages kept on a pool's stack. */
+#define STACK_MAX 64
+
+/* Most pre-zeroed pages kept per pool, and the count at which
+   the zeroing thread is woken to refill them. */
+#define ZERO_MAX 32
+#define ZERO_LOW 8
+
+/* A free block, as stored in its own first page. */
+struct free_block {
+	struct list_elem elem;          /* Element in free list. */
+};
 
 /* A memory pool. */
 struct pool {
-	struct lock lock;               /* Mutual exclusion. */
-	struct bitmap *used_map;        /* Bitmap of free pages. */
 	uint8_t *base;                  /* Base of pool. */
+	uint64_t first_pfn;             /* Physical page number of BASE. */
+	size_t page_cnt;                /* Number of pages, usable or not. */
+	size_t free_cnt;                /* Number of free pages. */
+	uint8_t *orders;                /* BLOCK_FREE | order of each free
+	                                   block's first page, else 0. */
+	struct list free_lists[MAX_ORDER + 1];  /* Free blocks by order. */
+	struct list stack;              /* Free single pages, newest first. */
+	size_t stack_cnt;               /* Number of pages in STACK. */
+	struct list zeroed;             /* Free pages filled with zeros. */
+	size_t zeroed_cnt;              /* Number of pages in ZEROED. */
+	uint64_t zero_hits;             /* PAL_ZERO pages from ZEROED. */
+	uint64_t zero_misses;           /* PAL_ZERO pages zeroed on demand. */
+	uint64_t lent_cnt;              /* Pages lent to the other pool. */
+	size_t low_wm;                  /* Low watermark, in free pages. */
+	size_t high_wm;                 /* High watermark, in free pages. */
+	bool low;                       /* Under pressure? */
+	bool reported_low;              /* LOW as last told to watchers. */
+	struct list watchers;           /* Registered palloc_watchers. */
+#ifndef NDEBUG
+	struct bitmap *used_map;        /* Bitmap of used pages. */
+#endif
 };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
+/* A thread that palloc wakes up from any context, even with
+   interrupts off inside the scheduler, where sema_up() might
+   yield. */
+struct daemon {
+	struct thread *thread;          /* The thread. */
+	bool idle;                      /* Blocked waiting for work? */
+	bool (*has_work) (void);        /* Checked with interrupts off. */
+};
+
+static bool zero_has_work (void);
+static bool pressure_has_work (void);
+static struct daemon zero_daemon = { .has_work = zero_has_work };
+static struct daemon pressure_daemon = { .has_work = pressure_has_work };
+
+/* Wakes daemon D if it is waiting.  Must be called with
+   interrupts off. */
+static void
+daemon_wake (struct daemon *d) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (d->idle) {
+		d->idle = false;
+		thread_unblock (d->thread);
+	}
+}
+
+/* Blocks the running thread, daemon D, until there is work. */
+static void
+daemon_wait (struct daemon *d) {
+	enum intr_level old_level = intr_disable ();
+
+	d->thread = thread_current ();
+	if (!d->has_work ()) {
+		d->idle = true;
+		thread_block ();
+	}
+	intr_set_level (old_level);
+}
+
+/* Serializes access to watcher lists. */
+static struct lock watch_lock;
+
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
+
+/* Percentage of pages to put in user pool. */
+unsigned user_pool_percent = 50;
+
+/* Pages the kernel pool keeps beyond the kernel image, whatever
+   USER_POOL_PERCENT says. */
+#define KERN_POOL_MIN 1024
+
+/* Let each pool borrow from the other? */
+bool palloc_dynamic;
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static void add_range (struct pool *, uint64_t pfn, size_t page_cnt);
 
 /* multiboot info */
 struct multiboot_info {
@@ -116,7 +250,8 @@ resolve_area_info (struct area *base_mem, struct area *ext_mem) {
 /*
  * Populate the pool.
  * All the pages are manged by this allocator, even include code page.
- * Basically, give half of memory to kernel, half to user.
+ * Basically, give half of memory to kernel, half to user, or
+ * USER_POOL_PERCENT percent to user.
  * We push base_mem portion to the kernel as much as possible.
  */
 static void
@@ -125,8 +260,14 @@ populate_pools (struct area *base_mem, struct area *ext_mem) {
 	void *free_start = pg_round_up (&_end);
 
 	uint64_t total_pages = (base_mem->size + ext_mem->size) / PGSIZE;
-	uint64_t user_pages = total_pages / 2 > user_page_limit ?
-		user_page_limit : total_pages / 2;
+	uint64_t user_share = total_pages * user_pool_percent / 100;
+	uint64_t user_pages = user_share > user_page_limit ?
+		user_page_limit : user_share;
+	uint64_t kern_min = vtop (free_start) / PGSIZE + KERN_POOL_MIN;
+	if (total_pages < kern_min)
+		user_pages = 0;
+	else if (user_pages > total_pages - kern_min)
+		user_pages = total_pages - kern_min;
 	uint64_t kern_pages = total_pages - user_pages;
 
 	// Parse E820 map to claim the memory region for each pool.
@@ -194,7 +335,8 @@ populate_pools (struct area *base_mem, struct area *ext_mem) {
 	uint64_t usable_bound = (uint64_t) free_start;
 	struct pool *pool;
 	void *pool_end;
-	size_t page_idx, page_cnt;
+	uint64_t page_pfn;
+	size_t page_cnt;
 
 	for (i = 0; i < mb_info->mmap_len / sizeof (struct e820_entry); i++) {
 		struct e820_entry *entry = &entries[i];
@@ -219,16 +361,16 @@ split:
 			else
 				NOT_REACHED ();
 
-			pool_end = pool->base + bitmap_size (pool->used_map) * PGSIZE;
-			page_idx = pg_no (start) - pg_no (pool->base);
+			pool_end = pool->base + pool->page_cnt * PGSIZE;
+			page_pfn = vtop ((void *) start) >> PGBITS;
 			if ((uint64_t) pool_end < end) {
 				page_cnt = ((uint64_t) pool_end - start) / PGSIZE;
-				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				add_range (pool, page_pfn, page_cnt);
 				start = (uint64_t) pool_end;
 				goto split;
 			} else {
 				page_cnt = ((uint64_t) end - start) / PGSIZE;
-				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				add_range (pool, page_pfn, page_cnt);
 			}
 		}
 	}
@@ -243,6 +385,7 @@ palloc_init (void) {
 	struct area base_mem = { .size = 0 };
 	struct area ext_mem = { .size = 0 };
 
+	lock_init (&watch_lock);
 	resolve_area_info (&base_mem, &ext_mem);
 	printf ("Pintos booting with: \n");
 	printf ("\tbase_mem: 0x%llx ~ 0x%llx (Usable: %'llu kB)\n",
@@ -253,6 +396,251 @@ palloc_init (void) {
 	return ext_mem.end;
 }
 
+/* Returns the first page of the block at physical page number
+   PFN. */
+static struct free_block *
+pfn_to_block (uint64_t pfn) {
+	return ptov (pfn << PGBITS);
+}
+
+/* Returns true if physical page number PFN is in POOL. */
+static bool
+pfn_in_pool (const struct pool *pool, uint64_t pfn) {
+	return pfn >= pool->first_pfn && pfn - pool->first_pfn < pool->page_cnt;
+}
+
+/* Returns the smallest order whose blocks hold PAGE_CNT pages. */
+static int
+order_for (size_t page_cnt) {
+	int order = 0;
+
+	while (((size_t) 1 << order) < page_cnt)
+		order++;
+	return order;
+}
+
+/* Adds the free block of 2**ORDER pages at PFN to POOL, merging it
+   with its buddy for as long as that is free. */
+static void
+free_block (struct pool *pool, uint64_t pfn, int order) {
+	while (order < MAX_ORDER) {
+		uint64_t buddy = pfn ^ ((uint64_t) 1 << order);
+
+		if (!pfn_in_pool (pool, buddy)
+				|| pool->orders[buddy - pool->first_pfn] != (BLOCK_FREE | order))
+			break;
+		list_remove (&pfn_to_block (buddy)->elem);
+		pool->orders[buddy - pool->first_pfn] = 0;
+		pfn &= ~((uint64_t) 1 << order);
+		order++;
+	}
+	pool->orders[pfn - pool->first_pfn] = BLOCK_FREE | order;
+	list_push_front (&pool->free_lists[order], &pfn_to_block (pfn)->elem);
+}
+
+/* Removes a block of 2**ORDER pages from POOL and returns its
+   physical page number, or 0 if there is no such block.  Page 0
+   is never free: it lies below the end of the kernel. */
+static uint64_t
+alloc_block (struct pool *pool, int order) {
+	struct free_block *b;
+	uint64_t pfn;
+	int k;
+
+	for (k = order; k <= MAX_ORDER; k++)
+		if (!list_empty (&pool->free_lists[k]))
+			break;
+	if (k > MAX_ORDER)
+		return 0;
+
+	b = list_entry (list_pop_front (&pool->free_lists[k]),
+			struct free_block, elem);
+	pfn = vtop (b) >> PGBITS;
+	pool->orders[pfn - pool->first_pfn] = 0;
+
+	/* Give back the upper half until the block is small enough. */
+	while (k > order) {
+		uint64_t half;
+
+		k--;
+		half = pfn + ((uint64_t) 1 << k);
+		pool->orders[half - pool->first_pfn] = BLOCK_FREE | k;
+		list_push_front (&pool->free_lists[k], &pfn_to_block (half)->elem);
+	}
+	return pfn;
+}
+
+/* Frees the PAGE_CNT pages at physical page number PFN into POOL,
+   as the largest aligned blocks that fit. */
+static void
+free_range (struct pool *pool, uint64_t pfn, size_t page_cnt) {
+	while (page_cnt > 0) {
+		int order = 0;
+
+		while (order < MAX_ORDER
+				&& (pfn & ((uint64_t) 1 << order)) == 0
+				&& ((size_t) 2 << order) <= page_cnt)
+			order++;
+		free_block (pool, pfn, order);
+		pfn += (uint64_t) 1 << order;
+		page_cnt -= (size_t) 1 << order;
+	}
+}
+
+/* Makes the PAGE_CNT usable pages at physical page number PFN
+   available in POOL.  Used only at boot. */
+static void
+add_range (struct pool *pool, uint64_t pfn, size_t page_cnt) {
+#ifndef NDEBUG
+	bitmap_set_multiple (pool->used_map, pfn - pool->first_pfn, page_cnt, false);
+#endif
+	pool->free_cnt += page_cnt;
+	free_range (pool, pfn, page_cnt);
+}
+
+/* Pushes free PAGE onto LIST, which has *CNT pages. */
+static void
+push_page (struct list *list, size_t *cnt, void *page) {
+	struct free_block *b = page;
+
+	list_push_front (list, &b->elem);
+	(*cnt)++;
+}
+
+/* Pops a free page from LIST, which has *CNT pages, or returns a
+   null pointer if LIST is empty.  Clears the list link from the
+   page, so that a page that was all zeros is again. */
+static void *
+pop_page (struct list *list, size_t *cnt) {
+	struct free_block *b;
+
+	if (list_empty (list))
+		return NULL;
+	b = list_entry (list_pop_front (list), struct free_block, elem);
+	(*cnt)--;
+	memset (b, 0, sizeof *b);
+	return b;
+}
+
+/* Takes a free page from POOL other than a pre-zeroed one, or
+   returns a null pointer if there is none. */
+static void *
+take_page (struct pool *pool) {
+	void *page = pop_page (&pool->stack, &pool->stack_cnt);
+
+	if (page == NULL) {
+		uint64_t pfn = alloc_block (pool, 0);
+		if (pfn != 0)
+			page = pfn_to_block (pfn);
+	}
+	return page;
+}
+
+/* Returns every page on POOL's stack and pre-zeroed list to the
+   buddy system, so that they may merge into larger blocks. */
+static void
+drain_pages (struct pool *pool) {
+	void *page;
+
+	while ((page = pop_page (&pool->stack, &pool->stack_cnt)) != NULL)
+		free_block (pool, vtop (page) >> PGBITS, 0);
+	while ((page = pop_page (&pool->zeroed, &pool->zeroed_cnt)) != NULL)
+		free_block (pool, vtop (page) >> PGBITS, 0);
+}
+
+/* Obtains a single page from POOL, or returns a null pointer if
+   there is none.  If ZERO, prefers a pre-zeroed page.  Sets *ZEROED
+   to whether the page is known to be all zeros. */
+static void *
+get_one_page (struct pool *pool, bool zero, bool *zeroed) {
+	void *page = NULL;
+
+	if (zero) {
+		page = pop_page (&pool->zeroed, &pool->zeroed_cnt);
+		if (page != NULL)
+			pool->zero_hits++;
+		else
+			pool->zero_misses++;
+	}
+	*zeroed = page != NULL;
+	if (page == NULL)
+		page = take_page (pool);
+	if (page == NULL) {
+		page = pop_page (&pool->zeroed, &pool->zeroed_cnt);
+		*zeroed = page != NULL;
+	}
+	if (pool->zeroed_cnt <= ZERO_LOW)
+		daemon_wake (&zero_daemon);
+	return page;
+}
+
+/* Obtains PAGE_CNT contiguous pages from POOL's buddy system, or
+   returns a null pointer if there are none. */
+static void *
+get_pages (struct pool *pool, size_t page_cnt) {
+	int order = order_for (page_cnt);
+	uint64_t pfn;
+
+	if (order > MAX_ORDER)
+		return NULL;
+	pfn = alloc_block (pool, order);
+	if (pfn == 0 && pool->stack_cnt + pool->zeroed_cnt > 0) {
+		drain_pages (pool);
+		pfn = alloc_block (pool, order);
+	}
+	if (pfn == 0)
+		return NULL;
+
+	/* Give back the pages beyond the request. */
+	if (((size_t) 1 << order) > page_cnt)
+		free_range (pool, pfn + page_cnt, ((size_t) 1 << order) - page_cnt);
+	return pfn_to_block (pfn);
+}
+
+/* Updates whether POOL is under pressure after its free page
+   count changed, and has the watchers told if that changed.  Must
+   be called with interrupts off. */
+static void
+update_pressure (struct pool *pool) {
+	bool low = pool->low;
+
+	if (!low && pool->free_cnt < pool->low_wm)
+		low = true;
+	else if (low && pool->free_cnt >= pool->high_wm)
+		low = false;
+	if (low != pool->low) {
+		pool->low = low;
+		daemon_wake (&pressure_daemon);
+	}
+}
+
+/* Obtains PAGE_CNT contiguous pages from POOL, or returns a null
+   pointer if there are none.  If ZERO, prefers a page known to be
+   zeroed, and sets *ZEROED to whether it got one; the caller zeroes
+   the pages otherwise, once interrupts are back on.  Must be called
+   with interrupts off. */
+static void *
+pool_get (struct pool *pool, size_t page_cnt, bool zero, bool *zeroed) {
+	void *pages;
+
+	*zeroed = false;
+	if (page_cnt == 1)
+		pages = get_one_page (pool, zero, zeroed);
+	else
+		pages = get_pages (pool, page_cnt);
+	if (pages == NULL)
+		return NULL;
+
+	pool->free_cnt -= page_cnt;
+	update_pressure (pool);
+#ifndef NDEBUG
+	size_t page_idx = pg_no (vtop (pages)) - pool->first_pfn;
+	ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+#endif
+	return pages;
+}
+
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
    If PAL_USER is set, the pages are obtained from the user pool,
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
@@ -262,24 +650,30 @@ palloc_init (void) {
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-
-	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-	lock_release (&pool->lock);
+	struct pool *other = flags & PAL_USER ? &kernel_pool : &user_pool;
+	bool zero = (flags & PAL_ZERO) != 0;
+	bool zeroed;
+	enum intr_level old_level;
 	void *pages;
 
-	if (page_idx != BITMAP_ERROR)
-		pages = pool->base + PGSIZE * page_idx;
-	else
-		pages = NULL;
+	ASSERT (page_cnt > 0);
 
-	if (pages) {
-		if (flags & PAL_ZERO)
-			memset (pages, 0, PGSIZE * page_cnt);
-	} else {
+	old_level = intr_disable ();
+	pages = pool_get (pool, page_cnt, zero, &zeroed);
+	if (pages == NULL && palloc_dynamic
+			&& (other == &user_pool
+				|| other->free_cnt >= other->high_wm + page_cnt)) {
+		pages = pool_get (other, page_cnt, zero, &zeroed);
+		if (pages != NULL)
+			other->lent_cnt += page_cnt;
+	}
+	intr_set_level (old_level);
+
+	if (pages == NULL) {
 		if (flags & PAL_ASSERT)
 			PANIC ("palloc_get: out of pages");
-	}
+	} else if (zero && !zeroed)
+		memset (pages, 0, PGSIZE * page_cnt);
 
 	return pages;
 }
@@ -296,11 +690,13 @@ palloc_get_page (enum palloc_flags flags) {
 	return palloc_get_multiple (flags, 1);
 }
 
-/* Frees the PAGE_CNT pages starting at PAGES. */
+/* Frees the PAGE_CNT pages starting at PAGES.  May be called with
+   interrupts off. */
 void
 palloc_free_multiple (void *pages, size_t page_cnt) {
 	struct pool *pool;
-	size_t page_idx;
+	enum intr_level old_level;
+	uint64_t pfn;
 
 	ASSERT (pg_ofs (pages) == 0);
 	if (pages == NULL || page_cnt == 0)
@@ -313,13 +709,24 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 	else
 		NOT_REACHED ();
 
-	page_idx = pg_no (pages) - pg_no (pool->base);
+	pfn = vtop (pages) >> PGBITS;
 
 #ifndef NDEBUG
 	memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
+	old_level = intr_disable ();
+#ifndef NDEBUG
+	size_t page_idx = pfn - pool->first_pfn;
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
 	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+#endif
+	pool->free_cnt += page_cnt;
+	update_pressure (pool);
+	if (page_cnt == 1 && pool->stack_cnt < STACK_MAX)
+		push_page (&pool->stack, &pool->stack_cnt, pages);
+	else
+		free_range (pool, pfn, page_cnt);
+	intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -328,31 +735,209 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
-/* Initializes pool P as starting at START and ending at END */
+/* Tops up POOL's pre-zeroed pages to ZERO_MAX, zeroing each page
+   with interrupts on. */
+static void
+refill_zeroed (struct pool *pool) {
+	for (;;) {
+		enum intr_level old_level = intr_disable ();
+		void *page = NULL;
+
+		if (pool->zeroed_cnt < ZERO_MAX)
+			page = take_page (pool);
+		intr_set_level (old_level);
+		if (page == NULL)
+			return;
+
+		memset (page, 0, PGSIZE);
+
+		old_level = intr_disable ();
+		push_page (&pool->zeroed, &pool->zeroed_cnt, page);
+		intr_set_level (old_level);
+	}
+}
+
+/* Returns true if a pool is short of pre-zeroed pages and has
+   other free pages to zero. */
+static bool
+zero_has_work (void) {
+	struct pool *pools[] = { &kernel_pool, &user_pool };
+
+	for (int i = 0; i < 2; i++)
+		if (pools[i]->zeroed_cnt <= ZERO_LOW
+				&& pools[i]->free_cnt > pools[i]->zeroed_cnt)
+			return true;
+	return false;
+}
+
+/* Keeps both pools supplied with pre-zeroed pages.  Runs at the
+   lowest priority, so that it mostly uses time in which the CPU
+   would be idle. */
+static void
+zero_thread (void *aux UNUSED) {
+	for (;;) {
+		refill_zeroed (&kernel_pool);
+		refill_zeroed (&user_pool);
+		daemon_wait (&zero_daemon);
+	}
+}
+
+/* Returns true if a pool's pressure changed since the watchers
+   were last told. */
+static bool
+pressure_has_work (void) {
+	return kernel_pool.low != kernel_pool.reported_low
+		|| user_pool.low != user_pool.reported_low;
+}
+
+/* Tells POOL's watchers if its pressure changed since last time. */
+static void
+report_pressure (struct pool *pool) {
+	enum intr_level old_level = intr_disable ();
+	bool low = pool->low;
+	bool changed = low != pool->reported_low;
+	struct list_elem *e;
+
+	pool->reported_low = low;
+	intr_set_level (old_level);
+	if (!changed)
+		return;
+
+	lock_acquire (&watch_lock);
+	for (e = list_begin (&pool->watchers); e != list_end (&pool->watchers);
+			e = list_next (e)) {
+		struct palloc_watcher *w = list_entry (e, struct palloc_watcher, elem);
+		void (*func) (void *aux) = low ? w->low : w->high;
+
+		if (func != NULL)
+			func (w->aux);
+	}
+	lock_release (&watch_lock);
+}
+
+/* Calls watchers as pools come under pressure or out of it. */
+static void
+pressure_thread (void *aux UNUSED) {
+	for (;;) {
+		report_pressure (&kernel_pool);
+		report_pressure (&user_pool);
+		daemon_wait (&pressure_daemon);
+	}
+}
+
+/* Starts the threads that zero free pages in the background and
+   report memory pressure.  Must be called after thread_start(). */
+void
+palloc_start_threads (void) {
+	thread_create ("pagezero", PRI_MIN, zero_thread, NULL);
+	thread_create ("mempressure", PRI_DEFAULT, pressure_thread, NULL);
+}
+
+/* Registers W, whose members other than ELEM must be set, to be
+   told about pressure on the user pool if W->user, otherwise on
+   the kernel pool.  W's callbacks run in a kernel thread of their
+   own, with no locks held except one that keeps them from running
+   concurrently with each other and with palloc_watch() and
+   palloc_unwatch(), so they must not call those. */
+void
+palloc_watch (struct palloc_watcher *w) {
+	struct pool *pool = w->user ? &user_pool : &kernel_pool;
+
+	lock_acquire (&watch_lock);
+	list_push_back (&pool->watchers, &w->elem);
+	lock_release (&watch_lock);
+}
+
+/* Unregisters W. */
+void
+palloc_unwatch (struct palloc_watcher *w) {
+	lock_acquire (&watch_lock);
+	list_remove (&w->elem);
+	lock_release (&watch_lock);
+}
+
+/* Sets the watermarks of the user pool if USER, otherwise of the
+   kernel pool, to LOW and HIGH free pages. */
+void
+palloc_set_watermarks (bool user, size_t low, size_t high) {
+	struct pool *pool = user ? &user_pool : &kernel_pool;
+	enum intr_level old_level;
+
+	ASSERT (low <= high);
+
+	old_level = intr_disable ();
+	pool->low_wm = low;
+	pool->high_wm = high;
+	update_pressure (pool);
+	intr_set_level (old_level);
+}
+
+/* Returns the number of free pages in the user pool if USER,
+   otherwise in the kernel pool. */
+size_t
+palloc_free_cnt (bool user) {
+	return user ? user_pool.free_cnt : kernel_pool.free_cnt;
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void) {
+	struct pool *pools[] = { &kernel_pool, &user_pool };
+
+	for (int i = 0; i < 2; i++) {
+		struct pool *pool = pools[i];
+
+		printf ("Palloc: %s pool %zu free pages, %"PRIu64" zeroed hits, "
+				"%"PRIu64" misses, %"PRIu64" pages lent\n",
+				i == 0 ? "kernel" : "user", pool->free_cnt, pool->zero_hits,
+				pool->zero_misses, pool->lent_cnt);
+	}
+}
+
+/* Initializes pool P as starting at START and ending at END, with
+   every page in use.  Its metadata goes at *BM_BASE, which is
+   advanced past it. */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
+  /* We'll put the pool's metadata at its base.
+     Calculate the space needed for it
      and subtract it from the pool's size. */
 	uint64_t pgcnt = (end - start) / PGSIZE;
-	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (pgcnt), PGSIZE) * PGSIZE;
+	size_t meta_pages = DIV_ROUND_UP (pgcnt, PGSIZE) * PGSIZE;
+	int order;
 
-	lock_init(&p->lock);
-	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
 	p->base = (void *) start;
+	p->first_pfn = vtop ((void *) start) >> PGBITS;
+	p->page_cnt = pgcnt;
+	p->free_cnt = 0;
+	p->orders = *bm_base;
+	memset (p->orders, 0, pgcnt);
+	for (order = 0; order <= MAX_ORDER; order++)
+		list_init (&p->free_lists[order]);
+	list_init (&p->stack);
+	p->stack_cnt = 0;
+	list_init (&p->zeroed);
+	p->zeroed_cnt = 0;
+	p->zero_hits = p->zero_misses = 0;
+	p->lent_cnt = 0;
+	p->low_wm = pgcnt / 64;
+	p->high_wm = pgcnt / 32;
+	p->low = p->reported_low = false;
+	list_init (&p->watchers);
+	*bm_base += meta_pages;
 
+#ifndef NDEBUG
+	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (pgcnt), PGSIZE) * PGSIZE;
+	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
 	// Mark all to unusable.
-	bitmap_set_all(p->used_map, true);
-
+	bitmap_set_all (p->used_map, true);
 	*bm_base += bm_pages;
+#endif
 }
 
 /* Returns true if PAGE was allocated from POOL,
    false otherwise. */
 static bool
 page_from_pool (const struct pool *pool, void *page) {
-	size_t page_no = pg_no (page);
-	size_t start_page = pg_no (pool->base);
-	size_t end_page = start_page + bitmap_size (pool->used_map);
-	return page_no >= start_page && page_no < end_page;
+	return pfn_in_pool (pool, vtop (page) >> PGBITS);
 }
@@ -0,0 +1,251 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* An object cache ("slab allocator").
+
+   malloc() rounds every request up to a power of 2, so an object
+   a little over a power of 2 in size wastes nearly half of its
+   block, and every object of a size class contends for the same
+   lock.  A kmem_cache instead serves objects of exactly one size,
+   from slabs: pages obtained from the page allocator, each
+   divided into as many objects as fit after a small header.
+
+   Each slab keeps its free objects on a list threaded through the
+   objects themselves.  The cache keeps its slabs on three lists,
+   by whether they are full, partly used, or empty, and allocates
+   from partly used slabs first, so that used objects crowd into
+   as few slabs as possible.  One empty slab is kept around to
+   absorb alloc/free cycles at a slab boundary; others go back to
+   the page allocator.  When the kernel pool runs low on pages,
+   the kept empty slabs go back too.
+
+   A cache may have a constructor, which is called once for each
+   object when its slab is created, not on every allocation.
+   Objects must be freed in their constructed state, e.g. with
+   any lock in them released, so that kmem_cache_alloc() can
+   hand them out again without reconstructing them.  A free
+   object's first word holds the free list link, so constructors
+   should leave it alone.  See [Bonwick] for the idea. */
+
+/* A slab: one page of objects, with this header at its start. */
+struct slab {
+	struct kmem_cache *cache;   /* Owning cache. */
+	struct list_elem elem;      /* Element in one of cache's lists. */
+	void *free;                 /* First free object, linked. */
+	size_t used;                /* Number of allocated objects. */
+};
+
+/* An object cache. */
+struct kmem_cache {
+	const char *name;           /* Name, for statistics. */
+	size_t size;                /* Object size, rounded up to ALIGN. */
+	size_t offset;              /* Offset of first object in slab. */
+	size_t per_slab;            /* Objects per slab. */
+	kmem_ctor_func *ctor;       /* Constructor, or null. */
+	struct lock lock;           /* Protects everything below. */
+	struct list full;           /* Slabs with no free objects. */
+	struct list partial;        /* Slabs with some free objects. */
+	struct list empty;          /* Slabs with no used objects. */
+	size_t slab_cnt;            /* Number of slabs. */
+	size_t used_cnt;            /* Number of allocated objects. */
+	struct list_elem elem;      /* Element in all_caches. */
+};
+
+/* Every cache, for kmem_print_stats(). */
+static struct list all_caches;
+
+static void kmem_reap (void *aux);
+
+/* Reaps the caches when the kernel pool is under pressure. */
+static struct palloc_watcher reaper = { .user = false, .low = kmem_reap };
+
+/* Initializes the object cache allocator. */
+void
+kmem_init (void) {
+	list_init (&all_caches);
+	palloc_watch (&reaper);
+}
+
+/* Frees every cache's empty slabs. */
+static void
+kmem_reap (void *aux UNUSED) {
+	struct list_elem *e;
+
+	/* Caches are never destroyed, so ALL_CACHES only grows. */
+	for (e = list_begin (&all_caches); e != list_end (&all_caches);
+			e = list_next (e)) {
+		struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+
+		lock_acquire (&c->lock);
+		while (!list_empty (&c->empty)) {
+			c->slab_cnt--;
+			palloc_free_page (list_entry (list_pop_front (&c->empty),
+						struct slab, elem));
+		}
+		lock_release (&c->lock);
+	}
+}
+
+/* Creates and returns a cache of objects SIZE bytes long, aligned
+   on ALIGN bytes (a power of 2, or 0 for pointer alignment).  If
+   CTOR is nonnull, it is called on each object when the object is
+   first created.  NAME is used in statistics and must outlive the
+   cache.  Returns a null pointer if memory is short. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, size_t align,
+		kmem_ctor_func *ctor) {
+	struct kmem_cache *c;
+
+	if (align < sizeof (void *))
+		align = sizeof (void *);
+	ASSERT ((align & (align - 1)) == 0);
+	ASSERT (size > 0);
+
+	c = malloc (sizeof *c);
+	if (c == NULL)
+		return NULL;
+
+	c->name = name;
+	c->size = ROUND_UP (size, align);
+	c->offset = ROUND_UP (sizeof (struct slab), align);
+	ASSERT (c->offset + c->size <= PGSIZE);
+	c->per_slab = (PGSIZE - c->offset) / c->size;
+	c->ctor = ctor;
+	lock_init (&c->lock);
+	list_init (&c->full);
+	list_init (&c->partial);
+	list_init (&c->empty);
+	c->slab_cnt = 0;
+	c->used_cnt = 0;
+
+	enum intr_level old_level = intr_disable ();
+	list_push_back (&all_caches, &c->elem);
+	intr_set_level (old_level);
+	return c;
+}
+
+/* Returns a new slab for cache C, with every object constructed
+   and free, or a null pointer if memory is short. */
+static struct slab *
+slab_create (struct kmem_cache *c) {
+	struct slab *s = palloc_get_page (0);
+	uint8_t *obj;
+	size_t i;
+
+	if (s == NULL)
+		return NULL;
+
+	s->cache = c;
+	s->free = NULL;
+	s->used = 0;
+	obj = (uint8_t *) s + c->offset + c->size * c->per_slab;
+	for (i = 0; i < c->per_slab; i++) {
+		obj -= c->size;
+		if (c->ctor != NULL)
+			c->ctor (obj);
+		*(void **) obj = s->free;
+		s->free = obj;
+	}
+	c->slab_cnt++;
+	return s;
+}
+
+/* Returns a free object from cache C, or a null pointer if memory
+   is short.  The object is as its constructor, if any, left it,
+   or as it was when freed; otherwise its contents are undefined,
+   except that its first word is garbage either way. */
+void *
+kmem_cache_alloc (struct kmem_cache *c) {
+	struct slab *s;
+	void *obj;
+
+	lock_acquire (&c->lock);
+	if (!list_empty (&c->partial))
+		s = list_entry (list_front (&c->partial), struct slab, elem);
+	else if (!list_empty (&c->empty)) {
+		s = list_entry (list_pop_front (&c->empty), struct slab, elem);
+		list_push_front (&c->partial, &s->elem);
+	} else {
+		s = slab_create (c);
+		if (s == NULL) {
+			lock_release (&c->lock);
+			return NULL;
+		}
+		list_push_front (&c->partial, &s->elem);
+	}
+
+	obj = s->free;
+	s->free = *(void **) obj;
+	s->used++;
+	c->used_cnt++;
+	if (s->free == NULL) {
+		list_remove (&s->elem);
+		list_push_back (&c->full, &s->elem);
+	}
+	lock_release (&c->lock);
+	return obj;
+}
+
+/* Returns OBJ, which must have come from kmem_cache_alloc(C), to
+   cache C.  OBJ may be null, in which case this does nothing. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj) {
+	struct slab *s;
+
+	if (obj == NULL)
+		return;
+
+	s = pg_round_down (obj);
+	ASSERT (s->cache == c);
+	ASSERT (((uint8_t *) obj - (uint8_t *) s - c->offset) % c->size == 0);
+
+	lock_acquire (&c->lock);
+	if (s->free == NULL) {
+		/* Was full. */
+		list_remove (&s->elem);
+		list_push_front (&c->partial, &s->elem);
+	}
+	*(void **) obj = s->free;
+	s->free = obj;
+	s->used--;
+	c->used_cnt--;
+	if (s->used == 0) {
+		list_remove (&s->elem);
+		if (list_empty (&c->empty))
+			list_push_back (&c->empty, &s->elem);
+		else {
+			c->slab_cnt--;
+			palloc_free_page (s);
+		}
+	}
+	lock_release (&c->lock);
+}
+
+/* Prints object cache statistics: for each cache, how many of the
+   objects in its slabs are in use, and what fraction of its slab
+   pages those objects occupy. */
+void
+kmem_print_stats (void) {
+	struct list_elem *e;
+
+	for (e = list_begin (&all_caches); e != list_end (&all_caches);
+			e = list_next (e)) {
+		struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+		size_t capacity = c->slab_cnt * c->per_slab;
+		size_t bytes = c->slab_cnt * PGSIZE;
+
+		printf ("Slab %s: %zu/%zu objects of %zu bytes in %zu slabs, "
+				"%zu%% of memory used\n",
+				c->name, c->used_cnt, capacity, c->size, c->slab_cnt,
+				bytes != 0 ? c->used_cnt * c->size * 100 / bytes : 0);
+	}
+}
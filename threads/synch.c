@@ -30,13 +30,42 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/interrupt.h"
+#include "threads/mp.h"
 #include "threads/thread.h"
+#include "devices/timer.h"
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 
 bool cmp_sema_priority(const struct list_elem *e, const struct list_elem *before, void * aux);
 bool comapare_priority(struct list_elem *element, struct list_elem *before,void * aux);
+
+/* A semaphore's `value' holds its count in the low bits and
+   SEMA_WAITERS while its waiters list may be nonempty.  Keeping
+   both in one word lets sema_down() and sema_up() take the common,
+   uncontended case with a single atomic instruction, without
+   turning interrupts off or touching the waiters list.  Only a
+   thread that finds the count at zero, or an up that finds
+   SEMA_WAITERS set, takes the slow path with interrupts off.
+
+   The waiters list is kept in priority order, highest first and
+   FIFO within a priority, so waking the highest-priority waiter is
+   O(1).  A waiter whose priority changes while it waits is moved
+   by sema_requeue(). */
+#define SEMA_WAITERS 0x80000000u
+#define SEMA_COUNT(V) ((V) & ~SEMA_WAITERS)
+
+/* Number of times lock_acquire() polls an adaptive lock whose
+   holder is running on another CPU before it blocks. */
+#define LOCK_SPIN_MAX 1000
+
+static bool sema_take (struct semaphore *);
+static bool waiter_more (const struct list_elem *, const struct list_elem *,
+		void *aux);
+static void lock_donate (struct lock *, int priority);
+static void lock_grant (struct lock *);
+static bool lock_take (struct lock *);
+static int rwlock_donated_priority (struct thread *);
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -52,6 +81,13 @@ bool cmp_sema_priority(const struct list_elem *e, const struct list_elem *before
 	struct semaphore_elem * a = list_entry(e,struct semaphore_elem,elem);
 	struct semaphore_elem * a_before = list_entry(before,struct semaphore_elem,elem);
 
+	/* A waiter whose cond_wait_timeout() expired has left its
+	   semaphore and sorts last. */
+	if (list_empty (&a->semaphore.waiters))
+		return false;
+	if (list_empty (&a_before->semaphore.waiters))
+		return true;
+
 	struct list_elem * b = list_begin(&(a->semaphore.waiters));
 	struct list_elem * b_before = list_begin(&(a_before->semaphore.waiters));
 
@@ -64,11 +100,33 @@ bool cmp_sema_priority(const struct list_elem *e, const struct list_elem *before
 void
 sema_init (struct semaphore *sema, unsigned value) {
 	ASSERT (sema != NULL);
+	ASSERT (value < SEMA_WAITERS);
 
 	sema->value = value;
 	list_init (&sema->waiters);
 }
 
+/* Decrements SEMA's count if it is positive.  Returns true if
+   successful, false if the count is 0.  Lock-free. */
+static bool
+sema_take (struct semaphore *sema) {
+	unsigned v = __atomic_load_n (&sema->value, __ATOMIC_RELAXED);
+
+	while (SEMA_COUNT (v) > 0)
+		if (__atomic_compare_exchange_n (&sema->value, &v, v - 1, false,
+					__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return true;
+	return false;
+}
+
+/* Orders threads in a waiters list by priority, highest first. */
+static bool
+waiter_more (const struct list_elem *a, const struct list_elem *b,
+		void *aux UNUSED) {
+	return list_entry (a, struct thread, elem)->priority
+		> list_entry (b, struct thread, elem)->priority;
+}
+
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
    to become positive and then atomically decrements it.
 
@@ -80,45 +138,101 @@ sema_init (struct semaphore *sema, unsigned value) {
 void
 sema_down (struct semaphore *sema) {
 	enum intr_level old_level;
+	struct thread *cur;
 
 	ASSERT (sema != NULL);
 	ASSERT (!intr_context ());
 
+	if (sema_take (sema))
+		return;
+
+	cur = thread_current ();
 	old_level = intr_disable ();
-	while (sema->value == 0) {
-		//list_push_back (&sema->waiters, &thread_current ()->elem);
-		list_insert_ordered(&sema->waiters,&thread_current() ->elem,comapare_priority,NULL);
-		
+	while (!sema_take (sema)) {
+		/* Make sema_up() take the slow path from now on, then check
+		   that no up slipped in before it did. */
+		if (SEMA_COUNT (__atomic_fetch_or (&sema->value, SEMA_WAITERS,
+						__ATOMIC_ACQ_REL)) > 0)
+			continue;
+
+		list_insert_ordered (&sema->waiters, &cur->elem, waiter_more, NULL);
+		cur->wait_sema = sema;
 		thread_block ();
 	}
-	sema->value--;
 	intr_set_level (old_level);
 }
-/* Down or "P" operation on a semaphore, but only if the
-   semaphore is not already 0.  Returns true if the semaphore is
-   decremented, false otherwise.
+/* Timer callback for sema_down_timeout(): takes thread T, if it
+   is still waiting, off its semaphore's waiters and wakes it. */
+static void
+sema_timeout_expired (void *t_) {
+	struct thread *t = t_;
+	struct semaphore *sema = t->wait_sema;
+
+	if (sema == NULL)
+		return;
+	list_remove (&t->elem);
+	t->wait_sema = NULL;
+	if (list_empty (&sema->waiters))
+		__atomic_fetch_and (&sema->value, ~SEMA_WAITERS, __ATOMIC_RELAXED);
+	thread_unblock (t);
+	if (t->cpu == cpu_current () && t->priority > thread_current ()->priority)
+		intr_yield_on_return ();
+}
 
-   This function may be called from an interrupt handler. */
+/* Like sema_down(), but gives up once TICKS timer ticks have
+   passed.  Returns true if SEMA was downed, false if the time ran
+   out first.  If TICKS is zero or negative, only tries once, like
+   sema_try_down().
+
+   The waiter sleeps on SEMA and on a timer at once, so it is woken
+   by whichever comes first, with no polling. */
 bool
-sema_try_down (struct semaphore *sema) {
+sema_down_timeout (struct semaphore *sema, int64_t ticks) {
 	enum intr_level old_level;
+	struct thread *cur;
+	struct timer timer;
 	bool success;
 
 	ASSERT (sema != NULL);
+	ASSERT (!intr_context ());
+
+	if (sema_take (sema))
+		return true;
+	if (ticks <= 0)
+		return false;
 
+	cur = thread_current ();
 	old_level = intr_disable ();
-	if (sema->value > 0)
-	{
-		sema->value--;
-		success = true;
+	timer_setup (&timer, sema_timeout_expired, cur);
+	timer_add (&timer, timer_ticks () + ticks);
+	while (!(success = sema_take (sema))) {
+		if (SEMA_COUNT (__atomic_fetch_or (&sema->value, SEMA_WAITERS,
+						__ATOMIC_ACQ_REL)) > 0)
+			continue;
+		if (!timer_pending (&timer))
+			break;
+
+		list_insert_ordered (&sema->waiters, &cur->elem, waiter_more, NULL);
+		cur->wait_sema = sema;
+		thread_block ();
 	}
-	else
-		success = false;
+	timer_cancel (&timer);
 	intr_set_level (old_level);
-
 	return success;
 }
 
+/* Down or "P" operation on a semaphore, but only if the
+   semaphore is not already 0.  Returns true if the semaphore is
+   decremented, false otherwise.
+
+   This function may be called from an interrupt handler. */
+bool
+sema_try_down (struct semaphore *sema) {
+	ASSERT (sema != NULL);
+
+	return sema_take (sema);
+}
+
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
    and wakes up one thread of those waiting for SEMA, if any.
 
@@ -126,21 +240,45 @@ sema_try_down (struct semaphore *sema) {
 void
 sema_up (struct semaphore *sema) {
 	enum intr_level old_level;
+	unsigned v;
 
 	ASSERT (sema != NULL);
 
+	/* Nobody to wake: just count. */
+	v = __atomic_load_n (&sema->value, __ATOMIC_RELAXED);
+	while (!(v & SEMA_WAITERS))
+		if (__atomic_compare_exchange_n (&sema->value, &v, v + 1, false,
+					__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			return;
+
 	old_level = intr_disable ();
-	if (!list_empty (&sema->waiters)){
-		list_sort(&sema->waiters, comapare_priority, NULL);
-		thread_unblock (list_entry (list_pop_front (&sema->waiters), struct thread, elem));
+	if (!list_empty (&sema->waiters)) {
+		struct thread *t = list_entry (list_pop_front (&sema->waiters),
+				struct thread, elem);
+		t->wait_sema = NULL;
+		thread_unblock (t);
 	}
+	__atomic_fetch_add (&sema->value, 1, __ATOMIC_RELEASE);
+	if (list_empty (&sema->waiters))
+		__atomic_fetch_and (&sema->value, ~SEMA_WAITERS, __ATOMIC_RELAXED);
 
-	sema->value++;
 	// thread_yield();
 	thread_test_preemption();
 	intr_set_level (old_level);
 }
 
+/* Moves T, which waits on SEMA, to the place in SEMA's waiters
+   that matches its priority, after the priority changed.  Must be
+   called with interrupts off. */
+void
+sema_requeue (struct semaphore *sema, struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (t->wait_sema == sema);
+
+	list_remove (&t->elem);
+	list_insert_ordered (&sema->waiters, &t->elem, waiter_more, NULL);
+}
+
 static void sema_test_helper (void *sema_);
 
 /* Self-test for semaphores that makes control "ping-pong"
@@ -196,9 +334,39 @@ lock_init (struct lock *lock) {
 	ASSERT (lock != NULL);
 
 	lock->holder = NULL;
+	lock->adaptive = false;
 	sema_init (&lock->semaphore, 1);
 }
 
+/* Makes LOCK adaptive, or not, according to ADAPTIVE.  A thread
+   that finds an adaptive lock held by a thread running on another
+   CPU polls it for a while before it blocks, which is cheaper
+   than a pair of context switches when the lock is held briefly.
+   Has no effect with a single CPU. */
+void
+lock_set_adaptive (struct lock *lock, bool adaptive) {
+	ASSERT (lock != NULL);
+
+	lock->adaptive = adaptive;
+}
+
+/* Polls adaptive LOCK for as long as its holder is running on
+   another CPU, up to LOCK_SPIN_MAX times.  Returns true if LOCK was
+   acquired. */
+static bool
+lock_spin (struct lock *lock) {
+	for (int i = 0; i < LOCK_SPIN_MAX; i++) {
+		struct thread *holder = lock->holder;
+
+		if (holder == NULL || holder->status != THREAD_RUNNING)
+			break;
+		asm volatile ("pause");
+		if (lock_take (lock))
+			return true;
+	}
+	return false;
+}
+
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
@@ -207,41 +375,139 @@ lock_init (struct lock *lock) {
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
    we need to sleep. */
-bool
-compare_donation_priority (struct list_elem *cur, struct list_elem *before, void *aux)
-{
-	return list_entry (cur, struct thread, d_elem)->priority > list_entry (before, struct thread, d_elem)->priority;
-}
-
 void
 lock_acquire (struct lock *lock) {
+	struct thread *cur = thread_current ();
+	enum intr_level old_level;
+
 	ASSERT (lock != NULL);
 	ASSERT (!intr_context ());
 	ASSERT (!lock_held_by_current_thread (lock));
-	struct thread *cur = thread_current();
-	if(!thread_mlfqs){
-	if(lock->holder){ 
-		// if(lock->holder->priority > cur->priority){ // lock->holder와 현재 스레드간의 priority 비교는 필수인지
-		// }
+
+	/* Uncontended. */
+	if (lock_take (lock) || (lock->adaptive && lock_spin (lock)))
+		return;
+
+	old_level = intr_disable ();
+	if (!thread_mlfqs && lock->holder != NULL) {
 		cur->wait_on_lock = lock;
-		list_insert_ordered(&lock->holder->donations, &cur->d_elem, compare_donation_priority, NULL);
-		//list_insert_ordered(&(thread_current()->wait_on_lock->holder->donations), &(thread_current()->d_elem),compare_donation_priority,NULL);
-		
-		// while(cur->wait_on_lock){ // wait_on_lock이 존재한다면,
-		// 	cur->wait_on_lock->holder->priority = cur->priority;
-		// 	cur = cur->wait_on_lock->holder;
-		// }
-		struct thread *start = thread_current();
-		while(start->wait_on_lock){ // wait_on_lock이 존재한다면 재귀 수행 -> nested donation!
-			struct thread *holder = start->wait_on_lock->holder;
-			holder->priority = start->priority;
-			start = holder;
-		}
-	}
+		lock_donate (lock, cur->priority);
 	}
 	sema_down (&lock->semaphore);
+	cur->wait_on_lock = NULL;
+	lock_grant (lock);
+	intr_set_level (old_level);
+}
+
+/* Raises the holder of LOCK to at least PRIORITY, and on down the
+   chain of locks that holder waits on, at most DONATE_DEPTH_MAX
+   deep.  The chain is cut off there rather than followed forever,
+   which only matters for very deep nesting or a deadlock. */
+static void
+lock_donate (struct lock *lock, int priority) {
+	for (int depth = 0; depth < DONATE_DEPTH_MAX && lock != NULL; depth++) {
+		struct thread *holder = lock->holder;
+
+		if (holder == NULL || holder->priority >= priority)
+			break;
+		thread_update_priority (holder, priority);
+		lock = holder->wait_on_lock;
+	}
+}
+
+/* Takes LOCK if it is free, and returns true if successful.  The
+   take and the recording of the current thread as holder happen in
+   one interrupts-off section, so a contender never finds LOCK taken
+   with no holder to donate its priority to. */
+static bool
+lock_take (struct lock *lock) {
+	enum intr_level old_level = intr_disable ();
+	bool success = sema_take (&lock->semaphore);
+
+	if (success)
+		lock_grant (lock);
+	intr_set_level (old_level);
+	return success;
+}
+
+/* Records that the current thread now holds LOCK. */
+static void
+lock_grant (struct lock *lock) {
+	struct thread *cur = thread_current ();
+	enum intr_level old_level;
+
+	old_level = intr_disable ();
 	lock->holder = cur;
+	list_push_back (&cur->held_locks, &lock->elem);
+	intr_set_level (old_level);
+}
+
+/* Returns the priority of the highest-priority thread waiting for
+   LOCK, or PRI_MIN - 1 if none.  The semaphore keeps its waiters
+   in priority order, so that is the first one. */
+static int
+lock_waiter_priority (struct lock *lock) {
+	struct list *waiters = &lock->semaphore.waiters;
+
+	if (list_empty (waiters))
+		return PRI_MIN - 1;
+	return list_entry (list_front (waiters), struct thread, elem)->priority;
+}
+
+/* Returns the highest priority donated to T by the threads
+   waiting on the locks and rwlocks it holds, or PRI_MIN - 1 if
+   none.  This costs one look per lock T holds, however many
+   threads wait on them. */
+int
+lock_donated_priority (struct thread *t) {
+	struct list_elem *e;
+	enum intr_level old_level;
+	int pri;
+
+	old_level = intr_disable ();
+	pri = rwlock_donated_priority (t);
+	for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
+			e = list_next (e))
+		pri = MAX (pri, lock_waiter_priority (list_entry (e, struct lock, elem)));
+	intr_set_level (old_level);
+	return pri;
+}
+
+/* Like lock_acquire(), but gives up once TICKS timer ticks have
+   passed.  Returns true if LOCK was acquired, false if the time
+   ran out first.  A waiter that gives up takes its donation back
+   from the holder, though not from threads further down the
+   holder's chain, which keep it until they release their locks. */
+bool
+lock_acquire_timeout (struct lock *lock, int64_t ticks) {
+	struct thread *cur = thread_current ();
+	enum intr_level old_level;
+	bool success;
+
+	ASSERT (lock != NULL);
+	ASSERT (!intr_context ());
+	ASSERT (!lock_held_by_current_thread (lock));
+
+	if (lock_take (lock))
+		return true;
+
+	old_level = intr_disable ();
+	if (!thread_mlfqs && lock->holder != NULL) {
+		cur->wait_on_lock = lock;
+		lock_donate (lock, cur->priority);
+	}
+	success = sema_down_timeout (&lock->semaphore, ticks);
 	cur->wait_on_lock = NULL;
+	if (success)
+		lock_grant (lock);
+	else if (!thread_mlfqs && lock->holder != NULL) {
+		struct thread *holder = lock->holder;
+
+		thread_update_priority (holder,
+				MAX (holder->original_priority, lock_donated_priority (holder)));
+	}
+	intr_set_level (old_level);
+	return success;
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -252,62 +518,38 @@ lock_acquire (struct lock *lock) {
    interrupt handler. */
 bool
 lock_try_acquire (struct lock *lock) {
-	bool success;
-
 	ASSERT (lock != NULL);
 	ASSERT (!lock_held_by_current_thread (lock));
 
-	success = sema_try_down (&lock->semaphore);
-	if (success)
-		lock->holder = thread_current ();
-	return success;
+	return lock_take (lock);
 }
 
 /* Releases LOCK, which must be owned by the current thread.
    This is lock_release function.
 
+   The current thread gives back the priority that LOCK's waiters
+   donated to it, keeping what waiters on other locks it holds
+   donated.
+
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
    handler. */
 void
 lock_release (struct lock *lock) {
+	struct thread *cur = thread_current ();
+	enum intr_level old_level;
+
 	ASSERT (lock != NULL);
 	ASSERT (lock_held_by_current_thread (lock));
-	
-	//if(thread_current()->original_priority != thread_get_priority) thread_set_priority(thread_current()->original_priority);
-	
-	if(!thread_mlfqs){
-	struct list_elem *e;
-	thread_current()->priority = thread_current()->original_priority;
-	
-	for (e = list_begin (&thread_current()->donations); e != list_end (&thread_current()->donations); e = list_next (e)){
-		// if(list_entry(e,struct thread, d_elem)->wait_on_lock == lock){
-		// 	//list_remove(&e);
-		// 	list_remove(&list_entry(e,struct thread,d_elem)->d_elem);
-		// }
-		struct thread *temp = list_entry (e, struct thread, d_elem);
-		if (temp->wait_on_lock == lock)
-			list_remove (&temp->d_elem);
-	}
-    struct thread *cur = thread_current ();
-	cur->priority = cur->original_priority;
-
-	// donations 중 맥스값과 오리지널 값 비교후 최대값 설정
-	if(!list_empty(&cur->donations)){
-		struct thread* max_thread = list_entry(list_max(&cur->donations,compare_donation_priority,NULL),struct thread,d_elem);
-		cur->priority = MAX(cur->priority,max_thread->priority);
-	}
-	}
-
-	// if (!list_empty (&cur->donations)) {
-	// 	list_sort (&cur->donations, compare_donation_priority,NULL);
-
-    // 	struct thread *front = list_entry (list_front (&cur->donations), struct thread, d_elem);
-	// 	if (front->priority > cur->priority)
-	// 		cur->priority = front->priority;
-    // }
 
+	old_level = intr_disable ();
+	list_remove (&lock->elem);
 	lock->holder = NULL;
+	if (!thread_mlfqs)
+		thread_update_priority (cur,
+				MAX (cur->original_priority, lock_donated_priority (cur)));
+	intr_set_level (old_level);
+
 	sema_up (&lock->semaphore);
 }
 
@@ -375,6 +617,36 @@ cond_wait (struct condition *cond, struct lock *lock) {
 	lock_acquire (lock);
 }
 
+/* Like cond_wait(), but gives up waiting for COND once TICKS
+   timer ticks have passed.  Either way, LOCK is reacquired before
+   returning.  Returns true if COND was signaled, false if the time
+   ran out first. */
+bool
+cond_wait_timeout (struct condition *cond, struct lock *lock, int64_t ticks) {
+	struct semaphore_elem waiter;
+	bool signaled;
+
+	ASSERT (cond != NULL);
+	ASSERT (lock != NULL);
+	ASSERT (!intr_context ());
+	ASSERT (lock_held_by_current_thread (lock));
+
+	sema_init (&waiter.semaphore, 0);
+	list_insert_ordered (&cond->waiters, &waiter.elem, cmp_sema_priority, NULL);
+	lock_release (lock);
+	signaled = sema_down_timeout (&waiter.semaphore, ticks);
+	lock_acquire (lock);
+
+	/* A signal may have picked WAITER between the timeout and
+	   reacquiring LOCK.  Otherwise, WAITER is still on COND. */
+	if (!signaled) {
+		signaled = sema_try_down (&waiter.semaphore);
+		if (!signaled)
+			list_remove (&waiter.elem);
+	}
+	return signaled;
+}
+
 /* If any threads are waiting on COND (protected by LOCK), then
    this function signals one of them to wake up from its wait.
    LOCK must be held before calling this function.
@@ -421,4 +693,270 @@ cond_broadcast (struct condition *cond, struct lock *lock) {
 
 	while (!list_empty (&cond->waiters))
 		cond_signal (cond, lock);
-}
\ No newline at end of file
+}
+
+/* Initializes reader-writer lock RW.  Any number of readers may
+   hold RW at once, or a single writer.
+
+   Writers have preference: once a writer waits, new readers wait
+   behind it, so a steady stream of readers cannot starve writers.
+   The lock is handed directly to the threads it wakes, highest
+   priority first, all waiting readers at once.
+
+   Waiters donate their priority to every holder, readers
+   included, and on through the lock the holder itself waits on,
+   if any, as lock_acquire() does.  A holder keeps the donation
+   until it releases RW.  Like locks, rwlocks are not recursive: a
+   thread must not acquire one it already holds, for reading or
+   for writing, and may hold at most RW_HOLD_MAX at a time. */
+void
+rwlock_init (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	rw->writer = NULL;
+	list_init (&rw->holders);
+	list_init (&rw->read_waiters);
+	list_init (&rw->write_waiters);
+}
+
+/* Returns the highest priority among RW's waiters, or PRI_MIN - 1
+   if there are none.  Interrupts must be off. */
+static int
+rw_waiter_priority (struct rwlock *rw) {
+	int pri = PRI_MIN - 1;
+
+	if (!list_empty (&rw->read_waiters))
+		pri = list_entry (list_front (&rw->read_waiters), struct thread, elem)->priority;
+	if (!list_empty (&rw->write_waiters))
+		pri = MAX (pri, list_entry (list_front (&rw->write_waiters),
+					struct thread, elem)->priority);
+	return pri;
+}
+
+/* Returns the highest priority donated to T by the waiters of the
+   rwlocks it holds, or PRI_MIN - 1 if none.  Interrupts must be
+   off. */
+static int
+rwlock_donated_priority (struct thread *t) {
+	int pri = PRI_MIN - 1;
+
+	for (int i = 0; i < RW_HOLD_MAX; i++)
+		if (t->rw_holds[i].lock != NULL)
+			pri = MAX (pri, rw_waiter_priority (t->rw_holds[i].lock));
+	return pri;
+}
+
+/* Raises every holder of RW to at least PRIORITY, following each
+   holder's chain of locks, as lock_acquire() does. */
+static void
+rw_donate (struct rwlock *rw, int priority) {
+	struct list_elem *e;
+
+	if (thread_mlfqs)
+		return;
+	for (e = list_begin (&rw->holders); e != list_end (&rw->holders);
+			e = list_next (e)) {
+		struct thread *t = list_entry (e, struct rw_hold, elem)->thread;
+
+		if (t->priority < priority) {
+			thread_update_priority (t, priority);
+			lock_donate (t->wait_on_lock, priority);
+		}
+	}
+}
+
+/* Makes T a holder of RW, as its writer if WRITE. */
+static void
+rw_grant (struct rwlock *rw, struct thread *t, bool write) {
+	for (int i = 0; i < RW_HOLD_MAX; i++) {
+		struct rw_hold *hold = &t->rw_holds[i];
+
+		ASSERT (hold->lock != rw);
+		if (hold->lock == NULL) {
+			hold->lock = rw;
+			hold->thread = t;
+			list_push_back (&rw->holders, &hold->elem);
+			if (write)
+				rw->writer = t;
+			return;
+		}
+	}
+	PANIC ("thread holds more than %d rwlocks", RW_HOLD_MAX);
+}
+
+/* Returns T's hold of RW, or a null pointer if T does not hold
+   RW. */
+static struct rw_hold *
+rw_find_hold (struct thread *t, const struct rwlock *rw) {
+	for (int i = 0; i < RW_HOLD_MAX; i++)
+		if (t->rw_holds[i].lock == rw)
+			return &t->rw_holds[i];
+	return NULL;
+}
+
+/* Blocks the running thread on WAITERS of RW until it is granted
+   RW.  Interrupts must be off. */
+static void
+rw_wait (struct rwlock *rw, struct list *waiters) {
+	struct thread *cur = thread_current ();
+
+	list_insert_ordered (waiters, &cur->elem, waiter_more, NULL);
+	rw_donate (rw, cur->priority);
+	thread_block ();
+	ASSERT (rw_find_hold (cur, rw) != NULL);
+}
+
+/* Acquires RW for reading, sleeping until no writer holds or
+   waits for it if necessary.  Must not be called within an
+   interrupt handler. */
+void
+rwlock_read_acquire (struct rwlock *rw) {
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+	ASSERT (!rwlock_held_by_current_thread (rw));
+
+	old_level = intr_disable ();
+	if (rw->writer == NULL && list_empty (&rw->write_waiters))
+		rw_grant (rw, thread_current (), false);
+	else
+		rw_wait (rw, &rw->read_waiters);
+	intr_set_level (old_level);
+}
+
+/* Acquires RW for writing, sleeping until nobody holds it if
+   necessary.  Must not be called within an interrupt handler. */
+void
+rwlock_write_acquire (struct rwlock *rw) {
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+	ASSERT (!rwlock_held_by_current_thread (rw));
+
+	old_level = intr_disable ();
+	if (list_empty (&rw->holders))
+		rw_grant (rw, thread_current (), true);
+	else
+		rw_wait (rw, &rw->write_waiters);
+	intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread must hold, for reading or
+   for writing.  If that leaves RW free, hands it to the
+   highest-priority waiting writer or, if none, to every waiting
+   reader. */
+static void
+rw_release (struct rwlock *rw) {
+	struct thread *cur = thread_current ();
+	struct rw_hold *hold;
+	enum intr_level old_level;
+
+	old_level = intr_disable ();
+	hold = rw_find_hold (cur, rw);
+	ASSERT (hold != NULL);
+	list_remove (&hold->elem);
+	hold->lock = NULL;
+	if (rw->writer == cur)
+		rw->writer = NULL;
+
+	if (list_empty (&rw->holders)) {
+		if (!list_empty (&rw->write_waiters)) {
+			struct thread *t = list_entry (list_pop_front (&rw->write_waiters),
+					struct thread, elem);
+			rw_grant (rw, t, true);
+			thread_unblock (t);
+		} else {
+			while (!list_empty (&rw->read_waiters)) {
+				struct thread *t = list_entry (list_pop_front (&rw->read_waiters),
+						struct thread, elem);
+				rw_grant (rw, t, false);
+				thread_unblock (t);
+			}
+		}
+		/* The new holders inherit from whoever still waits. */
+		rw_donate (rw, rw_waiter_priority (rw));
+	}
+
+	/* Give back what RW's waiters donated. */
+	if (!thread_mlfqs)
+		thread_update_priority (cur,
+				MAX (cur->original_priority, lock_donated_priority (cur)));
+	intr_set_level (old_level);
+	thread_test_preemption ();
+}
+
+/* Releases RW, which the current thread must hold for reading. */
+void
+rwlock_read_release (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+	ASSERT (rw->writer != thread_current ());
+
+	rw_release (rw);
+}
+
+/* Releases RW, which the current thread must hold for writing. */
+void
+rwlock_write_release (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+	ASSERT (rw->writer == thread_current ());
+
+	rw_release (rw);
+}
+
+/* Returns true if the current thread holds RW, for reading or for
+   writing, false otherwise. */
+bool
+rwlock_held_by_current_thread (const struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	return rw_find_hold (thread_current (), rw) != NULL;
+}
+/* Initializes spin lock LOCK as free.
+
+   A spin lock is the only primitive that works before a CPU has
+   a thread to block, and the only one that excludes other CPUs
+   while interrupts are off, which is what intr_disable() builds
+   on.  It is never held across a context switch by a thread,
+   only by a CPU. */
+void
+spin_init (struct spinlock *lock) {
+	ASSERT (lock != NULL);
+
+	lock->locked = 0;
+	lock->holder = NULL;
+}
+
+/* Acquires LOCK, spinning until it is free.  Interrupts must be
+   off, so that the holder cannot be preempted, and LOCK must not
+   already be held by this CPU. */
+void
+spin_lock (struct spinlock *lock) {
+	ASSERT (lock != NULL);
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (!spin_held (lock));
+
+	while (__atomic_exchange_n (&lock->locked, 1, __ATOMIC_ACQUIRE))
+		while (lock->locked)
+			asm volatile ("pause");
+	lock->holder = cpu_current ();
+}
+
+/* Releases LOCK, which must be held by this CPU. */
+void
+spin_unlock (struct spinlock *lock) {
+	ASSERT (lock != NULL);
+	ASSERT (spin_held (lock));
+
+	lock->holder = NULL;
+	__atomic_store_n (&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+/* Returns true if this CPU holds LOCK, false otherwise. */
+bool
+spin_held (const struct spinlock *lock) {
+	ASSERT (lock != NULL);
+
+	return lock->locked && lock->holder == cpu_current ();
+}
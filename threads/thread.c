@@ -6,10 +6,15 @@
 #include <string.h>
 #include "threads/flags.h"
 #include "threads/interrupt.h"
+#include "threads/kstack.h"
 #include "threads/intr-stubs.h"
+#include "threads/lapic.h"
+#include "threads/mp.h"
 #include "threads/palloc.h"
+#include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #include "intrinsic.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -24,17 +29,37 @@
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-
-/* List of blocked threads. when timer_sleep() called, the thread(currently running)
-   is pushed to the tail of this list. when wakeup() called, head of
-   this list will be popped and be pushed to ready_list. *
-/* Idle thread. */
+/* Multi-level run queue for threads in THREAD_READY state.
+   There is one FIFO list per priority level, and bit P of BITMAP
+   is set whenever QUEUES[P] is nonempty, so inserting a thread,
+   removing one and finding the highest-priority ready thread are
+   all O(1), with no sorting under disabled interrupts. */
+struct run_queue {
+	struct list queues[PRI_MAX + 1];    /* One FIFO per priority. */
+	uint64_t bitmap;                    /* Bit P set iff QUEUES[P] nonempty. */
+	size_t cnt;                         /* Number of ready threads. */
+	int64_t epoch;                      /* MLFQS epoch of the levels. */
+};
+
+/* One run queue per CPU.  A ready thread is queued on the run
+   queue of the CPU in its `cpu' member.  Run queues are protected
+   by turning interrupts off, so with more than one CPU they share
+   the kernel lock in interrupt.c. */
+static struct run_queue ready_queues[CPU_MAX];
+#define cpu_rq(C) (&ready_queues[(C)->id])
+
+/* List of all processes.  Processes are added to this list
+   when they are first scheduled and removed when they exit. */
+static struct list all_list;
 
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
+/* Thread structure and kernel stack of the initial thread.  The
+   stack is defined in start.S. */
+static struct thread initial_thread_struct;
+extern uint8_t initial_kstack[];
+
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
@@ -45,28 +70,57 @@ static struct list destruction_req;
 static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
-void thread_test_preemption (void);
+static long long steals;        /* # of threads pulled from another CPU. */
+static long long migrations;    /* # of times a thread ran on a new CPU. */
+
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
+#define CACHE_HOT_TICKS 1       /* # of ticks a thread's cache stays warm. */
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* MLFQS bookkeeping.  MLFQS_EPOCH counts the seconds since boot;
+   the recent_cpu decay coefficient that took effect at the start of
+   epoch E is kept in mlfqs_decay[E % MLFQS_HISTORY].  A thread's
+   recent_cpu is current as of its recent_cpu_epoch and is brought up
+   to date only when the thread is queued or runs again, so the
+   timer interrupt never walks the thread lists. */
+#define MLFQS_HISTORY 64
+static int64_t mlfqs_epoch;
+static int mlfqs_decay[MLFQS_HISTORY];
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
+static void idle_loop (void) NO_RETURN;
 static struct thread *next_thread_to_run (void);
-static void init_thread (struct thread *, const char *name, int priority);
+static struct thread *new_thread (const char *name, int priority);
+static tid_t create_thread (const char *name, int priority,
+		thread_func *, void *aux, bool child);
+static void init_thread (struct thread *, const char *name, int priority,
+		void *stack);
 static void do_schedule(int status);
 static void schedule (void);
 static tid_t allocate_tid (void);
+static struct cpu *select_cpu (struct thread *);
+static struct thread *steal_thread (struct cpu *);
+static void kick_idle_cpu (void);
 bool comapare_priority(struct list_elem *element, struct list_elem *before,void * aux);
 
-struct list ready_list;
-struct list sleep_list; 
+static void rq_init (struct run_queue *);
+static void rq_push (struct run_queue *, struct thread *);
+static void rq_remove (struct run_queue *, struct thread *);
+static struct thread *rq_pop (struct run_queue *);
+static int rq_max_priority (const struct run_queue *);
+static void rq_for_each (struct run_queue *,
+		void (*) (struct thread *, void *), void *);
+
+static int mlfqs_priority (struct thread *);
+static void mlfqs_catch_up (struct thread *);
+static void mlfqs_recompute_priority (struct thread *, void *aux);
 
 int READY_THREADS;
 int LOAD_AVG;
@@ -78,13 +132,12 @@ int LOAD_AVG;
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 /* Returns the running thread.
- * Read the CPU's stack pointer `rsp', and then round that
- * down to the start of a page.  Since `struct thread' is
- * always at the beginning of a page and the stack pointer is
- * somewhere in the middle, this locates the curent thread. */
-#define running_thread() ((struct thread *) (pg_round_down (rrsp ())))
+ * Read the CPU's stack pointer `rsp', and then follow the owner
+ * slot at the top of the kernel stack that contains it.  Since
+ * every kernel stack is aligned to its size, that slot is found
+ * by rounding `rsp' alone.  See threads/kstack.h. */
+#define running_thread() (*kstack_owner (rrsp ()))
 
-bool compare_donation_priority (const struct list_elem *cur, const struct list_elem *before, void *aux);
 extern bool thread_mlfqs;
 // Global descriptor table for the thread_start.
 // Because the gdt will be setup after the thread_init, we should
@@ -93,8 +146,9 @@ static uint64_t gdt[3] = { 0, 0x00af9a000000ffff, 0x00cf92000000ffff };
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
-   general and it is possible in this case only because loader.S
-   was careful to put the bottom of the stack at a page boundary.
+   general and it is possible in this case only because start.S
+   was careful to run the kernel on initial_kstack, which is
+   aligned like any other kernel stack.
 
    Also initializes the run queue and the tid lock.
 
@@ -110,7 +164,8 @@ thread_init (void) {
 
 	/* Reload the temporal gdt for the kernel
 	 * This gdt does not include the user context.
-	 * The kernel will rebuild the gdt with user context, in gdt_init (). */
+	 * The kernel will rebuild the gdt with user context, in gdt_init (),
+	 * or with just a TSS added, in intr_init (). */
 	struct desc_ptr gdt_ds = {
 		.size = sizeof (gdt) - 1,
 		.address = (uint64_t) gdt
@@ -119,17 +174,22 @@ thread_init (void) {
 
 	/* Init the globla thread context */
 	lock_init (&tid_lock);
-	list_init (&ready_list);
-	list_init (&sleep_list);
+	for (int i = 0; i < CPU_MAX; i++)
+		rq_init (&ready_queues[i]);
+	list_init (&all_list);
 	list_init (&destruction_req);
 
 	READY_THREADS = 0; // 초기화 
 	LOAD_AVG = 0; // 초기화
 
 	/* Set up a thread structure for the running thread. */
-	initial_thread = running_thread ();
-	init_thread (initial_thread, "main", PRI_DEFAULT);
+	initial_thread = &initial_thread_struct;
+	init_thread (initial_thread, "main", PRI_DEFAULT, initial_kstack);
+	ASSERT (running_thread () == initial_thread);
 	initial_thread->status = THREAD_RUNNING;
+	initial_thread->cpu = initial_thread->last_cpu = &cpus[0];
+	cpus[0].curr = initial_thread;
+	cpus[0].started = true;
 	/* initialize the sleep queue date structure */
 	initial_thread->wakeup_tick = 0; // ? 
 
@@ -157,9 +217,10 @@ thread_start (void) {
 void
 thread_tick (void) {
 	struct thread *t = thread_current ();
+	struct cpu *c = t->cpu;
 
 	/* Update statistics. */
-	if (t == idle_thread)
+	if (t == c->idle_thread)
 		idle_ticks++;
 #ifdef USERPROG
 	else if (t->pml4 != NULL)
@@ -169,7 +230,7 @@ thread_tick (void) {
 		kernel_ticks++;
 
 	/* Enforce preemption. */
-	if (++thread_ticks >= TIME_SLICE)
+	if (++c->thread_ticks >= TIME_SLICE)
 		intr_yield_on_return ();
 }
 
@@ -178,6 +239,8 @@ void
 thread_print_stats (void) {
 	printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
 			idle_ticks, kernel_ticks, user_ticks);
+	printf ("Scheduler: %d CPUs, %lld steals, %lld migrations\n",
+			cpu_cnt, steals, migrations);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -198,18 +261,35 @@ thread_print_stats (void) {
 tid_t
 thread_create (const char *name, int priority,
 		thread_func *function, void *aux) {
+	return create_thread (name, priority, function, aux, false);
+}
+
+#ifdef USERPROG
+/* Like thread_create(), but also makes the new thread a child of
+   the running thread, before it can run, so that process_wait()
+   can wait for it.  For user processes only: a child that exits
+   stays around until its parent has collected its status or has
+   exited itself. */
+tid_t
+thread_create_child (const char *name, int priority,
+		thread_func *function, void *aux) {
+	return create_thread (name, priority, function, aux, true);
+}
+#endif
+
+/* Does the work of thread_create() and thread_create_child(). */
+static tid_t
+create_thread (const char *name, int priority,
+		thread_func *function, void *aux, bool child UNUSED) {
 	struct thread *t;
 	tid_t tid;
 
 	ASSERT (function != NULL);
 
 	/* Allocate thread. */
-	t = palloc_get_page (PAL_ZERO);
+	t = new_thread (name, priority);
 	if (t == NULL)
 		return TID_ERROR;
-
-	/* Initialize thread. */
-	init_thread (t, name, priority);
 	tid = t->tid = allocate_tid ();
 
 	/* Call the kernel_thread if it scheduled.
@@ -221,15 +301,19 @@ thread_create (const char *name, int priority,
 	t->tf.es = SEL_KDSEG;
 	t->tf.ss = SEL_KDSEG;
 	t->tf.cs = SEL_KCSEG;
-	t->tf.eflags = FLAG_IF;
+	t->tf.eflags = 0;       /* kernel_thread() turns interrupts on. */
 
+#ifdef USERPROG
+	/* Let the creator wait for it.  See process_wait(). */
+	if (child) {
+		t->parent = thread_current ();
+		list_push_back (&t->parent->children, &t->sibling_elem);
+	}
+#endif
 
 	/* Add to run queue. */
-	thread_unblock (t); // sorted by priority
+	thread_unblock (t);
 	// if newly created thread priority is bigger than current thread, yield.
-	struct list_elem *temp = list_begin(&ready_list);
-	struct thread *head_thread = list_entry (temp, struct thread, elem);
-
 	thread_test_preemption();
 	return tid;
 }
@@ -248,14 +332,6 @@ thread_block (void) {
 	schedule ();
 }
 
-/* Transitions a blocked thread T to the ready-to-run state.
-   This is an error if T is not blocked.  (Use thread_yield() to
-   make the running thread ready.)
-
-   This function does not preempt the running thread.  This can
-   be important: if the caller had disabled interrupts itself,
-   it may expect that it can atomically unblock a thread and
-   update other data. */
 bool
 comapare_priority(struct list_elem *element, struct list_elem *before,void * aux){
 
@@ -265,18 +341,38 @@ comapare_priority(struct list_elem *element, struct list_elem *before,void * aux
 	
 	return false;
 }
+
+/* Transitions a blocked thread T to the ready-to-run state.
+   This is an error if T is not blocked.  (Use thread_yield() to
+   make the running thread ready.)
+
+   This function does not preempt the running thread.  This can
+   be important: if the caller had disabled interrupts itself,
+   it may expect that it can atomically unblock a thread and
+   update other data.
+
+   T goes on the run queue of the CPU it last ran on, or of the
+   least loaded CPU if it never ran.  If that is another CPU and T
+   should preempt what it is running, it is sent a reschedule
+   IPI; if T has to wait there instead, an idle CPU is sent one,
+   to come and steal it. */
 void
 thread_unblock (struct thread *t) {
 	enum intr_level old_level;
+	struct cpu *c;
 
 	ASSERT (is_thread (t));
 
 	old_level = intr_disable ();
 	ASSERT (t->status == THREAD_BLOCKED);
-	//list_push_back (&ready_list, &t->elem);
-	//list_sort(&ready_list,comapare_priority,NULL);
-	list_insert_ordered(&ready_list,&t->elem,comapare_priority,NULL);
+	c = t->cpu = select_cpu (t);
+	rq_push (cpu_rq (c), t);
 	t->status = THREAD_READY;
+	if (c->curr == c->idle_thread || c->curr->priority < t->priority) {
+		if (c != cpu_current ())
+			lapic_send_ipi (c->apic_id, LAPIC_VEC_RESCHED);
+	} else
+		kick_idle_cpu ();
 	intr_set_level (old_level);
 }
 
@@ -294,10 +390,11 @@ thread_current (void) {
 	struct thread *t = running_thread ();
 
 	/* Make sure T is really a thread.
-	   If either of these assertions fire, then your thread may
-	   have overflowed its stack.  Each thread has less than 4 kB
-	   of stack, so a few big automatic arrays or moderate
-	   recursion can cause stack overflow. */
+	   If either of these assertions fire, then the owner slot at
+	   the top of the kernel stack may have been overwritten.  Each
+	   thread has KSTACK_PAGES - 1 pages of stack above a guard
+	   page (see threads/kstack.h), so running off the bottom of
+	   the stack faults in the guard page instead. */
 	ASSERT (is_thread (t));
 	ASSERT (t->status == THREAD_RUNNING);
 
@@ -320,9 +417,11 @@ thread_exit (void) {
 	process_exit ();
 #endif
 
-	/* Just set our status to dying and schedule another process.
-	   We will be destroyed during the call to schedule_tail(). */
+	/* Remove thread from all threads list, set our status to dying,
+	   and schedule another process.  That process will destroy us
+	   when it calls schedule(). */
 	intr_disable ();
+	list_remove (&thread_current ()->allelem);
 	do_schedule (THREAD_DYING);
 	NOT_REACHED ();
 }
@@ -337,56 +436,59 @@ thread_yield (void) {
 	ASSERT (!intr_context ()); 
 
 	old_level = intr_disable ();
-	if (curr != idle_thread)
-		list_insert_ordered(&ready_list,&curr->elem,comapare_priority,NULL);
-		//list_push_back (&ready_list, &curr->elem);
-	
+	if (curr != curr->cpu->idle_thread)
+		rq_push (cpu_rq (curr->cpu), curr);
+
 	do_schedule (THREAD_READY);
 	intr_set_level (old_level); // set a state of interrupt to the state passed to parameter and return previous interrupt state.
 }
 
+/* Yields the CPU if a ready thread has a higher priority than
+   the running thread. */
 void thread_test_preemption (void){
-   if (!list_empty(&ready_list) && !intr_context() && thread_current()->priority < list_entry(list_front(&ready_list), struct thread, elem)->priority){
+	struct thread *cur = thread_current ();
+
+	if (!intr_context () && cur->priority < rq_max_priority (cpu_rq (cur->cpu)))
 		thread_yield ();
-	}
+}
+
+/* Sets T's effective priority to PRIORITY.  If T is in the ready
+   state it is moved to the run queue level matching its new
+   priority, and if it waits on a semaphore, to its new place among
+   the waiters, so donation and MLFQS recomputation never leave a
+   thread queued at a stale level. */
+void
+thread_update_priority (struct thread *t, int priority) {
+	enum intr_level old_level;
+
+	ASSERT (is_thread (t));
+	ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+	old_level = intr_disable ();
+	if (t->status == THREAD_READY && t->priority != priority) {
+		rq_remove (cpu_rq (t->cpu), t);
+		t->priority = priority;
+		rq_push (cpu_rq (t->cpu), t);
+	} else if (t->status == THREAD_BLOCKED && t->wait_sema != NULL
+			&& t->priority != priority) {
+		t->priority = priority;
+		sema_requeue (t->wait_sema, t);
+	} else
+		t->priority = priority;
+	intr_set_level (old_level);
 }
 
 void
 thread_set_priority (int new_priority) {
 	struct thread *cur = thread_current ();
 	cur->original_priority = new_priority;
-	cur->priority = cur->original_priority;
-
-	if(!thread_mlfqs){ // mlfqs 테스트가 아니어야만 도네이션 적용
-	if (!list_empty (&cur->donations)) {
-		list_sort (&cur->donations, compare_donation_priority,NULL);
+	if (thread_mlfqs)
+		cur->priority = new_priority;
+	else
+		cur->priority = MAX (new_priority, lock_donated_priority (cur));
 
-    	struct thread *front = list_entry (list_front (&cur->donations), struct thread, d_elem);
-		if (front->priority > cur->priority)
-			cur->priority = front->priority;
-    } 
-	}
-	// if (thread_current()->wait_on_lock){ // 내가 donation한 스레드가 존재한다면, 
-	// 	struct thread *donated_thread = thread_current()->wait_on_lock->holder;
-	// 	struct thread * max_thread = list_entry(list_max(&thread_current()->donations,compare_donation_priority,NULL),struct thread, d_elem);
-	// 	donated_thread->priority = max_thread->priority;
-	// }
-
-	struct list_elem *t = list_begin(&ready_list);
-	struct thread * cur_thread;
-	cur_thread = list_entry (t, struct thread, elem);
-	// if(cur_thread->priority > new_priority){
-	// 	//list_sort(ready_list)
-	// 	thread_yield(); //preemptive!
-	// } 
-	// thread_test_preemption();
-	
-	if (!list_empty (&ready_list)) {
-		struct thread *next = list_entry(list_begin(&ready_list), struct thread, elem);
-		if (next != NULL && next->priority > new_priority) {
-			thread_yield();
-		}
-  	}
+	if (rq_max_priority (cpu_rq (cur->cpu)) > new_priority)
+		thread_yield();
 }
 
 /* Returns the current thread's priority. */
@@ -395,11 +497,18 @@ thread_get_priority (void) {
 	return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+   its priority, yielding if it no longer has the highest. */
 void
-thread_set_nice (int nice UNUSED) {
-	/* TODO: Your implementation goes here */
-	thread_current()->nice = nice;
+thread_set_nice (int nice) {
+	struct thread *cur = thread_current ();
+	enum intr_level old_level = intr_disable ();
+
+	cur->nice = nice;
+	if (thread_mlfqs)
+		cur->priority = mlfqs_priority (cur);
+	intr_set_level (old_level);
+	thread_test_preemption ();
 }
  
 /* Returns the current thread's nice value. */
@@ -420,46 +529,153 @@ thread_get_load_avg (void) {
 int
 thread_get_recent_cpu (void) {
 	/* TODO: Your implementation goes here */
-	return convert_x_to_int_round_to_nearest(mul_x_by_n(thread_current()->recent_cpu,100));
+	struct thread *cur = thread_current ();
+	enum intr_level old_level = intr_disable ();
+	int recent_cpu;
+
+	mlfqs_catch_up (cur);
+	recent_cpu = cur->recent_cpu;
+	intr_set_level (old_level);
+	return convert_x_to_int_round_to_nearest(mul_x_by_n(recent_cpu,100));
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
 
-   The idle thread is initially put on the ready list by
+   The boot CPU's idle thread is initially put on the ready list by
    thread_start().  It will be scheduled once initially, at which
-   point it initializes idle_thread, "up"s the semaphore passed
-   to it to enable thread_start() to continue, and immediately
-   blocks.  After that, the idle thread never appears in the
-   ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   point it initializes its CPU's idle_thread, "up"s the semaphore
+   passed to it to enable thread_start() to continue, and
+   immediately blocks.  After that, the idle thread never appears
+   in the ready list.  It is returned by next_thread_to_run() as a
+   special case when the ready list is empty.  Other CPUs start out
+   running their idle threads; see thread_init_ap(). */
 static void
 idle (void *idle_started_ UNUSED) {
 	struct semaphore *idle_started = idle_started_;
 
-	idle_thread = thread_current ();
+	cpu_current ()->idle_thread = thread_current ();
 	sema_up (idle_started);
+	idle_loop ();
+}
 
+/* Body of every idle thread. */
+static void
+idle_loop (void) {
 	for (;;) {
 		/* Let someone else run. */
 		intr_disable ();
 		thread_block ();
 
-		/* Re-enable interrupts and wait for the next one.
+		/* In tickless mode, sleep until the next timer deadline
+		   rather than the next tick. */
+		timer_idle_enter ();
+
+		/* Re-enable interrupts and wait for the next one. */
+		intr_halt ();
+	}
+}
+
+/* Creates the idle thread of application processor C.  C enters
+   the kernel on this thread's stack, so the thread starts out
+   running; see mp_start_aps().  Returns a null pointer if memory
+   is short. */
+struct thread *
+thread_init_ap (struct cpu *c) {
+	struct thread *t = new_thread ("idle", PRI_MIN);
+
+	if (t == NULL)
+		return NULL;
+	t->tid = allocate_tid ();
+	t->status = THREAD_RUNNING;
+	t->cpu = t->last_cpu = c;
+	c->idle_thread = c->curr = t;
+	return t;
+}
 
-		   The `sti' instruction disables interrupts until the
-		   completion of the next instruction, so these two
-		   instructions are executed atomically.  This atomicity is
-		   important; otherwise, an interrupt could be handled
-		   between re-enabling interrupts and waiting for the next
-		   one to occur, wasting as much as one clock tick worth of
-		   time.
+/* Starts scheduling on the running application processor, which
+   must be set up to take interrupts, by turning the caller into
+   its idle thread. */
+void
+thread_start_ap (void) {
+	struct cpu *c = cpu_current ();
 
-		   See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
-		   7.11.1 "HLT Instruction". */
-		asm volatile ("sti; hlt" : : : "memory");
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (thread_current () == c->idle_thread);
+
+	c->started = true;
+	idle_loop ();
+}
+
+/* Returns the CPU the caller is running on.  Until the boot CPU
+   has a thread, that is the boot CPU. */
+struct cpu *
+cpu_current (void) {
+	struct thread *t = running_thread ();
+
+	return is_thread (t) && t->cpu != NULL ? t->cpu : &cpus[0];
+}
+
+/* Returns how many threads other than idle threads are running. */
+size_t
+thread_running_count (void) {
+	size_t cnt = 0;
+
+	for (int i = 0; i < cpu_cnt; i++)
+		if (cpus[i].started && cpus[i].curr != cpus[i].idle_thread)
+			cnt++;
+	return cnt;
+}
+
+/* Sends a reschedule IPI to some other CPU that is idle, if any,
+   so that it steals from a backlogged run queue. */
+static void
+kick_idle_cpu (void) {
+	struct cpu *self = cpu_current ();
+
+	for (int i = 0; i < cpu_cnt; i++) {
+		struct cpu *c = &cpus[i];
+		if (c != self && c->started && c->curr == c->idle_thread) {
+			lapic_send_ipi (c->apic_id, LAPIC_VEC_RESCHED);
+			return;
+		}
 	}
 }
 
+/* Returns the number of ready threads plus the running thread, if
+   not idle, of CPU C. */
+static size_t
+cpu_load (struct cpu *c) {
+	return cpu_rq (c)->cnt + (c->curr != c->idle_thread);
+}
+
+/* Chooses the CPU whose run queue ready thread T should join: the
+   one it last ran on, whose caches are likely still warm, or for
+   a new thread, the least loaded one, preferring the caller's. */
+static struct cpu *
+select_cpu (struct thread *t) {
+	struct cpu *best;
+	size_t best_load;
+
+	if (t->last_cpu != NULL)
+		return t->last_cpu;
+
+	best = cpu_current ();
+	best_load = cpu_load (best);
+	for (int i = 0; i < cpu_cnt; i++) {
+		struct cpu *c = &cpus[i];
+		size_t load;
+
+		if (!c->started)
+			continue;
+		load = cpu_load (c);
+		if (load < best_load) {
+			best = c;
+			best_load = load;
+		}
+	}
+	return best;
+}
+
 /* Function used as the basis for a kernel thread. */
 static void
 kernel_thread (thread_func *function, void *aux) {
@@ -471,38 +687,224 @@ kernel_thread (thread_func *function, void *aux) {
 }
 
 
+/* Allocates a thread structure and a kernel stack and initializes
+   them as a blocked thread named NAME.  Returns a null pointer if
+   memory is short. */
+static struct thread *
+new_thread (const char *name, int priority) {
+	struct thread *t = palloc_get_page (0);
+	void *stack = kstack_alloc ();
+
+	if (t == NULL || stack == NULL) {
+		palloc_free_page (t);
+		if (stack != NULL)
+			kstack_free (stack);
+		return NULL;
+	}
+	init_thread (t, name, priority, stack);
+	return t;
+}
+
 /* Does basic initialization of T as a blocked thread named
-   NAME. */
+   NAME, running on kernel stack STACK. */
 static void
-init_thread (struct thread *t, const char *name, int priority) {
+init_thread (struct thread *t, const char *name, int priority, void *stack) {
+	enum intr_level old_level;
+
 	ASSERT (t != NULL);
 	ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
 	ASSERT (name != NULL);
+	ASSERT (stack != NULL);
 
 	memset (t, 0, sizeof *t);
 	t->status = THREAD_BLOCKED;
 	strlcpy (t->name, name, sizeof t->name);
-	t->tf.rsp = (uint64_t) t + PGSIZE - sizeof (void *);
+	t->stack = stack;
+	*kstack_owner ((uint64_t) stack) = t;
+	/* As if kernel_thread() had been called from the stack top. */
+	t->tf.rsp = KSTACK_TOP (stack) - sizeof (void *);
 	t->priority = priority;
 	t->original_priority = priority;
 	t->wait_on_lock= NULL;
-	list_init(&t->donations);
+	list_init (&t->held_locks);
+	list_init (&t->children);
+	t->exit_status = -1;
+	sema_init (&t->exit_sema, 0);
+	sema_init (&t->reap_sema, 0);
 	t->magic = THREAD_MAGIC;
 	t->nice = 0;
 	t->recent_cpu = 0;
+	t->recent_cpu_epoch = mlfqs_epoch;
+
+	old_level = intr_disable ();
+	list_push_back (&all_list, &t->allelem);
+	intr_set_level (old_level);
 }
 
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   the CPU's idle thread.  The priority and MLFQS schedulers share
+   this path: both keep the run queue indexed by current priority.
+   Only the running CPU's run queue is considered. */
 static struct thread *
 next_thread_to_run (void) {
-	if (list_empty (&ready_list))
-		return idle_thread;
-	else
-		return list_entry (list_pop_front (&ready_list), struct thread, elem);
+	struct cpu *c = cpu_current ();
+	struct run_queue *rq = cpu_rq (c);
+	struct thread *t;
+
+	/* Ready threads are re-leveled once per second, after their
+	   recent_cpu has decayed, rather than by the timer interrupt. */
+	if (thread_mlfqs && rq->epoch != mlfqs_epoch) {
+		rq->epoch = mlfqs_epoch;
+		rq_for_each (rq, mlfqs_recompute_priority, NULL);
+	}
+
+	t = rq_pop (rq);
+	if (t == NULL && cpu_cnt > 1)
+		t = steal_thread (c);
+	return t != NULL ? t : c->idle_thread;
+}
+
+/* Returns true if T ran so recently that its working set is
+   probably still in its last CPU's cache. */
+static bool
+cache_hot (const struct thread *t) {
+	return t->last_cpu != NULL && timer_ticks () - t->last_run < CACHE_HOT_TICKS;
+}
+
+/* Work stealing.  Removes and returns, for idle CPU C, the
+   highest-priority thread queued on the busiest other CPU,
+   preferring at that priority a thread whose cache has gone cold,
+   or returns a null pointer if every other run queue is empty. */
+static struct thread *
+steal_thread (struct cpu *c) {
+	struct cpu *busiest = NULL;
+	struct run_queue *rq;
+	struct list *level;
+	struct list_elem *e;
+	struct thread *t;
+
+	for (int i = 0; i < cpu_cnt; i++) {
+		struct cpu *p = &cpus[i];
+		if (p != c && p->started && cpu_rq (p)->cnt > 0
+				&& (busiest == NULL || cpu_rq (p)->cnt > cpu_rq (busiest)->cnt))
+			busiest = p;
+	}
+	if (busiest == NULL)
+		return NULL;
+
+	rq = cpu_rq (busiest);
+	level = &rq->queues[rq_max_priority (rq)];
+	t = list_entry (list_front (level), struct thread, elem);
+	for (e = list_begin (level); e != list_end (level); e = list_next (e)) {
+		struct thread *cand = list_entry (e, struct thread, elem);
+		if (!cache_hot (cand)) {
+			t = cand;
+			break;
+		}
+	}
+
+	rq_remove (rq, t);
+	t->cpu = c;
+	steals++;
+	return t;
+}
+
+/* Initializes run queue RQ as empty. */
+static void
+rq_init (struct run_queue *rq) {
+	int pri;
+
+	for (pri = PRI_MIN; pri <= PRI_MAX; pri++)
+		list_init (&rq->queues[pri]);
+	rq->bitmap = 0;
+	rq->cnt = 0;
+}
+
+/* Appends T to the tail of the RQ level for its priority. */
+static void
+rq_push (struct run_queue *rq, struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (thread_mlfqs) {
+		mlfqs_catch_up (t);
+		t->priority = mlfqs_priority (t);
+	}
+	ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+	t->rq_priority = t->priority;
+	list_push_back (&rq->queues[t->rq_priority], &t->elem);
+	rq->bitmap |= 1ULL << t->rq_priority;
+	rq->cnt++;
+}
+
+/* Removes T, which must be queued in RQ. */
+static void
+rq_remove (struct run_queue *rq, struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (rq->cnt > 0);
+
+	list_remove (&t->elem);
+	if (list_empty (&rq->queues[t->rq_priority]))
+		rq->bitmap &= ~(1ULL << t->rq_priority);
+	rq->cnt--;
+}
+
+/* Removes and returns the oldest thread at the highest nonempty
+   level of RQ, or a null pointer if RQ is empty. */
+static struct thread *
+rq_pop (struct run_queue *rq) {
+	struct thread *t;
+	int pri = rq_max_priority (rq);
+
+	if (pri < PRI_MIN)
+		return NULL;
+	t = list_entry (list_front (&rq->queues[pri]), struct thread, elem);
+	rq_remove (rq, t);
+	return t;
+}
+
+/* Returns the highest priority with a ready thread in RQ, or
+   PRI_MIN - 1 if RQ is empty. */
+static int
+rq_max_priority (const struct run_queue *rq) {
+	if (rq->bitmap == 0)
+		return PRI_MIN - 1;
+	return 63 - __builtin_clzll (rq->bitmap);
+}
+
+/* Returns the number of threads in the ready state, on every
+   CPU. */
+size_t
+thread_ready_count (void) {
+	size_t cnt = 0;
+
+	for (int i = 0; i < cpu_cnt; i++)
+		cnt += ready_queues[i].cnt;
+	return cnt;
+}
+
+/* Calls FUNC on every ready thread, passing AUX along.  Must be
+   called with interrupts off.  FUNC may move the thread to another
+   level with thread_update_priority(); a thread that moves up may
+   be visited twice, so FUNC must be idempotent. */
+static void
+rq_for_each (struct run_queue *rq, void (*func) (struct thread *, void *),
+		void *aux) {
+	int pri;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	for (pri = PRI_MIN; pri <= PRI_MAX; pri++) {
+		struct list_elem *e;
+		if (!(rq->bitmap & (1ULL << pri)))
+			continue;
+		for (e = list_begin (&rq->queues[pri]); e != list_end (&rq->queues[pri]); ) {
+			struct thread *t = list_entry (e, struct thread, elem);
+			e = list_next (e);
+			func (t, aux);
+		}
+	}
 }
 
 /* Use iretq to launch the thread */
@@ -545,61 +947,17 @@ do_iret (struct intr_frame *tf) {
    added at the end of the function. */
 static void
 thread_launch (struct thread *th) {
-	uint64_t tf_cur = (uint64_t) &running_thread ()->tf;
-	uint64_t tf = (uint64_t) &th->tf;
+	struct thread *cur = running_thread ();
+
 	ASSERT (intr_get_level () == INTR_OFF);
 
-	/* The main switching logic.
-	 * We first restore the whole execution context into the intr_frame
-	 * and then switching to the next thread by calling do_iret.
-	 * Note that, we SHOULD NOT use any stack from here
-	 * until switching is done. */
-	__asm __volatile (
-			/* Store registers that will be used. */
-			"push %%rax\n"
-			"push %%rbx\n"
-			"push %%rcx\n"
-			/* Fetch input once */
-			"movq %0, %%rax\n"
-			"movq %1, %%rcx\n"
-			"movq %%r15, 0(%%rax)\n"
-			"movq %%r14, 8(%%rax)\n"
-			"movq %%r13, 16(%%rax)\n"
-			"movq %%r12, 24(%%rax)\n"
-			"movq %%r11, 32(%%rax)\n"
-			"movq %%r10, 40(%%rax)\n"
-			"movq %%r9, 48(%%rax)\n"
-			"movq %%r8, 56(%%rax)\n"
-			"movq %%rsi, 64(%%rax)\n"
-			"movq %%rdi, 72(%%rax)\n"
-			"movq %%rbp, 80(%%rax)\n"
-			"movq %%rdx, 88(%%rax)\n"
-			"pop %%rbx\n"              // Saved rcx
-			"movq %%rbx, 96(%%rax)\n"
-			"pop %%rbx\n"              // Saved rbx
-			"movq %%rbx, 104(%%rax)\n"
-			"pop %%rbx\n"              // Saved rax
-			"movq %%rbx, 112(%%rax)\n"
-			"addq $120, %%rax\n"
-			"movw %%es, (%%rax)\n"
-			"movw %%ds, 8(%%rax)\n"
-			"addq $32, %%rax\n"
-			"call __next\n"         // read the current rip.
-			"__next:\n"
-			"pop %%rbx\n"
-			"addq $(out_iret -  __next), %%rbx\n"
-			"movq %%rbx, 0(%%rax)\n" // rip
-			"movw %%cs, 8(%%rax)\n"  // cs
-			"pushfq\n"
-			"popq %%rbx\n"
-			"mov %%rbx, 16(%%rax)\n" // eflags
-			"mov %%rsp, 24(%%rax)\n" // rsp
-			"movw %%ss, 32(%%rax)\n"
-			"mov %%rcx, %%rdi\n"
-			"call do_iret\n"
-			"out_iret:\n"
-			: : "g"(tf_cur), "g" (tf) : "memory"
-			);
+	/* A thread that has run before gave up the CPU in here, so
+	 * only its callee-saved registers and stack pointer need to
+	 * come back.  A new thread starts from its intr_frame. */
+	if (th->switch_rsp != 0)
+		switch_threads (&cur->switch_rsp, th->switch_rsp);
+	else
+		switch_to_frame (&cur->switch_rsp, &th->tf);
 }
 
 /* Schedules a new process. At entry, interrupts must be off.
@@ -613,40 +971,41 @@ do_schedule(int status) {
 	while (!list_empty (&destruction_req)) {
 		struct thread *victim =
 			list_entry (list_pop_front (&destruction_req), struct thread, elem);
-		palloc_free_page(victim);
+		kstack_free (victim->stack);
+		palloc_free_page (victim);
 	}
 	thread_current ()->status = status;
 	schedule ();
 }
 
-struct thread*
-next_thread_to_run_mlfqs(void){
-	if (list_empty (&ready_list))
-		return idle_thread;
-	else{
-		list_sort(&ready_list,comapare_priority,NULL);
-		return list_entry (list_pop_front (&ready_list), struct thread, elem);
-	}
-}
-
 static void
 schedule (void) {
 	struct thread *curr = running_thread ();
-	//struct thread *next = next_thread_to_run (); // mlfq에서는 다른 스케줄링 방식을 사용해야함!
-	struct thread *next = next_thread_to_run_mlfqs();
+	struct thread *next = next_thread_to_run ();
+	struct cpu *c = curr->cpu;
 
 	ASSERT (intr_get_level () == INTR_OFF);
 	ASSERT (curr->status != THREAD_RUNNING);
 	ASSERT (is_thread (next));
-	/* Mark us as running. */
+	/* Mark us as running, here. */
 	next->status = THREAD_RUNNING;
+	next->cpu = c;
+	c->curr = next;
+	if (next->last_cpu != c) {
+		if (next->last_cpu != NULL)
+			migrations++;
+		next->last_cpu = c;
+	}
+	next->last_run = timer_ticks ();
 
 	/* Start new time slice. */
-	thread_ticks = 0;
+	c->thread_ticks = 0;
 
 #ifdef USERPROG
 	/* Activate the new address space. */
 	process_activate (next);
+#else
+	intr_tss_update (next);
 #endif
 
 	if (curr != next) {
@@ -659,8 +1018,7 @@ schedule (void) {
 		   schedule(). */
 		if (curr && curr->status == THREAD_DYING && curr != initial_thread) {
 			ASSERT (curr != next);
-			//list_push_back (&destruction_req, &curr->elem);
-			list_insert_ordered(&destruction_req,&curr->elem,comapare_priority,NULL);
+			list_push_back (&destruction_req, &curr->elem);
 		}
 
 		/* Before switching the thread, we first save the information
@@ -683,37 +1041,115 @@ allocate_tid (void) {
 }
 
 
-//// implements 
+/* Timer callback that wakes the thread sleeping in thread_sleep(). */
+static void
+sleep_timer_expired (void *t_) {
+	struct thread *t = t_;
 
-void thread_sleep(int64_t ticks)
-{
+	thread_unblock (t);
+	if (t->cpu == cpu_current () && t->priority > thread_current ()->priority)
+		intr_yield_on_return ();
+}
+
+/* Blocks the running thread until the timer tick reaches
+   WAKEUP_TICK.  The wakeup is driven by a kernel timer on the
+   caller's stack, so the timer interrupt never scans sleepers. */
+void
+thread_sleep (int64_t wakeup_tick) {
 	struct thread *t = thread_current ();
+	struct timer timer;
 	enum intr_level old_level;
+
+	if (t == t->cpu->idle_thread)
+		return;
+
 	old_level = intr_disable ();
+	t->wakeup_tick = wakeup_tick;
+	timer_setup (&timer, sleep_timer_expired, t);
+	timer_add (&timer, wakeup_tick);
+	thread_block ();
+	intr_set_level (old_level);
+}
 
-	if (t != idle_thread){ // what should i do?
-		// update the global tick
-		t->wakeup_tick = ticks;
-		list_insert_ordered(&sleep_list,&t->elem,comapare_priority,NULL);
-		thread_block();
+/* Invokes FUNC on all threads, passing along AUX.
+   This function must be called with interrupts off. */
+void
+thread_foreach (thread_action_func *func, void *aux) {
+	struct list_elem *e;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (e = list_begin (&all_list); e != list_end (&all_list);
+			e = list_next (e)) {
+		struct thread *t = list_entry (e, struct thread, allelem);
+		func (t, aux);
 	}
-	intr_set_level (old_level);
-	/* if the current thread is not idle thread, change the state of the caller thread to BLOCKED,
-	   store the local tick to wake up, update the global tick if necessary, and call schedule()
-	   when you manipulate thread list, disable interrupt! */
-}
-
-void thread_wakeup(int64_t ticks)
-{	
-	//struct list_elem *t = sleep_list.head.next;
-	struct list_elem *t = list_begin(&sleep_list);
-	struct thread * cur_thread;
-	while (t != list_end(&sleep_list)){
-		cur_thread = list_entry (t, struct thread, elem);
-		if ( cur_thread->wakeup_tick <= ticks){
-			t = list_remove(t);
-			thread_unblock(cur_thread);
-		}
-		else t = list_next(t);
+}
+
+/* Returns the MLFQS priority of T computed from its recent_cpu
+   and nice values, clamped to [PRI_MIN, PRI_MAX]. */
+static int
+mlfqs_priority (struct thread *t) {
+	int priority = convert_x_to_int_round_to_nearest (sub_n_from_x (sub_y_from_x (convert_n_to_fp (PRI_MAX), div_x_by_n (t->recent_cpu, 4)), 2 * t->nice));
+
+	if (priority > PRI_MAX)
+		priority = PRI_MAX;
+	else if (priority < PRI_MIN)
+		priority = PRI_MIN;
+	return priority;
+}
+
+/* Applies to T's recent_cpu every per-second decay it missed since
+   it last ran or was queued.  A thread that was blocked for longer
+   than MLFQS_HISTORY seconds has its oldest missing decays
+   approximated by the oldest recorded coefficient. */
+static void
+mlfqs_catch_up (struct thread *t) {
+	int64_t oldest = mlfqs_epoch - MLFQS_HISTORY + 1;
+
+	while (t->recent_cpu_epoch < mlfqs_epoch) {
+		int64_t epoch = ++t->recent_cpu_epoch;
+		int decay = mlfqs_decay[(epoch < oldest ? oldest : epoch) % MLFQS_HISTORY];
+		t->recent_cpu = add_x_and_n (mul_x_by_y (decay, t->recent_cpu), t->nice);
 	}
-}
\ No newline at end of file
+}
+
+static void
+mlfqs_recompute_priority (struct thread *t, void *aux UNUSED) {
+	mlfqs_catch_up (t);
+	thread_update_priority (t, mlfqs_priority (t));
+}
+
+/* Recomputes the priority of the running thread, the only one
+   whose recent_cpu changed since the last recomputation, and
+   yields if a ready thread now outranks it.  Called from the timer
+   interrupt every fourth tick when the MLFQS scheduler is active. */
+void
+thread_mlfqs_recompute_priority (void) {
+	struct thread *cur = thread_current ();
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	mlfqs_catch_up (cur);
+	cur->priority = mlfqs_priority (cur);
+	if (cur->priority < rq_max_priority (cpu_rq (cur->cpu)))
+		intr_yield_on_return ();
+}
+
+/* Starts a new MLFQS epoch: records the decay coefficient for the
+   current load average and applies it to the running thread.  Other
+   threads catch up lazily.  Called from the timer interrupt once
+   per second. */
+void
+thread_mlfqs_update_recent_cpu (void) {
+	int decay_factor = div_x_by_y (mul_x_by_n (LOAD_AVG, 2), add_x_and_n (mul_x_by_n (LOAD_AVG, 2), 1));
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	mlfqs_epoch++;
+	mlfqs_decay[mlfqs_epoch % MLFQS_HISTORY] = decay_factor;
+	mlfqs_catch_up (thread_current ());
+
+	/* Let the scheduler re-level the ready threads.  Other CPUs do
+	   so at their next reschedule. */
+	if (cpu_rq (cpu_current ())->cnt > 0)
+		intr_yield_on_return ();
+}
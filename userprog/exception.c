@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
+#include "threads/kstack.h"
 #include "threads/thread.h"
 #include "intrinsic.h"
 
@@ -185,6 +186,9 @@ page_fault (struct intr_frame *f) {
 	write = (f->error_code & PF_W) != 0; // 접근 시도가 쓰기 였을 때 true, 읽기 였을 때 false입니다.
 	user = (f->error_code & PF_U) != 0; // 사용자 모드에서의 접근 시도일 때 true, 커널 모드에서의 접근 시도일 때 false입니다.
 
+	if (!user && kstack_in_guard (thread_current ()->stack, fault_addr))
+		PANIC ("Kernel stack overflow in thread %s", thread_name ());
+
 	// 구현하기: Call exit(-1) -> print the thread name and the exit status -1
 
 #ifdef VM
@@ -19,6 +19,8 @@
 #include "threads/vaddr.h"
 #include "intrinsic.h"
 #ifdef VM
+#include "threads/malloc.h"
+#include "vm/file.h"
 #include "vm/vm.h"
 #endif
 
@@ -68,7 +70,7 @@ tid_t process_create_initd(const char *file_name)
 	char *parsed_file_name = strtok_r(file_name, " ", ptr); // 추가
 
 	/* Create a new thread to execute FILE_NAME. */
-	tid = thread_create(parsed_file_name, PRI_DEFAULT, initd, fn_copy);
+	tid = thread_create_child(parsed_file_name, PRI_DEFAULT, initd, fn_copy);
 	if (tid == TID_ERROR)
 		palloc_free_page(fn_copy);
 	return tid;
@@ -94,8 +96,8 @@ initd(void *f_name)
 tid_t process_fork(const char *name, struct intr_frame *if_ UNUSED)
 {
 	/* Clone current thread to new thread.*/
-	return thread_create(name,
-											 PRI_DEFAULT, __do_fork, thread_current());
+	return thread_create_child(name,
+														 PRI_DEFAULT, __do_fork, thread_current());
 }
 
 #ifndef VM
@@ -309,7 +311,7 @@ process_exec(void *f_name)
  *
  * 이 함수는 문제 2-2에서 구현될 예정입니다. 현재는 아무것도 하지 않습니다.
  */
-int process_wait(tid_t child_tid UNUSED)
+int process_wait(tid_t child_tid)
 {
 	/* XXX: Hint) The pintos exit if process_wait (initd), we recommend you
 	 * XXX:       to add infinite loop here before
@@ -320,12 +322,28 @@ int process_wait(tid_t child_tid UNUSED)
 	 * XXX:       추가할 것을 권장합니다.
 	 */
 
-	int cnt = 9999999; // process_wait이 너무 일찍 끝나서 로깅이 안될수도 있음
-	while (cnt-- > 0)
+	struct thread *curr = thread_current();
+	struct list_elem *e;
+
+	/* A child that exits stays around, blocked in process_exit(),
+	 * until we collect its status here, so sleeping on its
+	 * exit_sema cannot miss the exit. */
+	for (e = list_begin(&curr->children); e != list_end(&curr->children);
+			 e = list_next(e))
 	{
+		struct thread *child = list_entry(e, struct thread, sibling_elem);
+		if (child->tid == child_tid)
+		{
+			int status;
+
+			sema_down(&child->exit_sema);
+			status = child->exit_status;
+			list_remove(&child->sibling_elem);
+			sema_up(&child->reap_sema);
+			return status;
+		}
 	}
-// 	while (1) {} // 핀토스에게 자식을 기다리고 있다고 속이기 위해, 무한 루프를 걸어준다.
-// 	return -1;
+	return -1;
 }
 
 /* Exit the process. This function is called by thread_exit (). */
@@ -340,6 +358,25 @@ process_exit(void)
 	// printf("%s: exit(%d)\n", curr->name, curr->exit_status);
 
 	process_cleanup();
+
+	/* Our children no longer have anyone to wait for them. */
+	while (!list_empty(&curr->children))
+	{
+		struct thread *child = list_entry(list_pop_front(&curr->children),
+																			struct thread, sibling_elem);
+		child->parent = NULL;
+		sema_up(&child->reap_sema);
+	}
+
+	/* Hand our status to the parent, and stay until it has it.
+	 * Only processes made by process_create_initd() and
+	 * process_fork() have a parent; other threads never wait
+	 * here. */
+	if (curr->parent != NULL)
+	{
+		sema_up(&curr->exit_sema);
+		sema_down(&curr->reap_sema);
+	}
 }
 
 /* Free the current process's resources. */
@@ -710,15 +747,23 @@ install_page(void *upage, void *kpage, bool writable)
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
+/* Lazy initializer for a page of an ELF segment, run on the first
+ * fault on it.  AUX is a struct file_page that says which part of
+ * the executable goes in the page; the anonymous page it becomes
+ * is already zeroed, so only that part has to be read. */
 static bool
 lazy_load_segment(struct page *page, void *aux)
 {
-	/* TODO: Load the segment from the file */
-	/* TODO: This called when the first page fault occurs on address VA. */
-	/* TODO: VA is available when calling this function. */
+	struct file_page *file_page = aux;
+	bool success;
+
+	success = file_read_at(file_page->file, page->frame->kva,
+												 file_page->read_bytes, file_page->offset) == (off_t)file_page->read_bytes;
+	free(aux);
+	return success;
 }
 
-/* Loads a segment starting at offset OFS in FILE at address
+/* Sets up a segment starting at offset OFS in FILE at address
  * UPAGE.  In total, READ_BYTES + ZERO_BYTES bytes of virtual
  * memory are initialized, as follows:
  *
@@ -730,16 +775,32 @@ lazy_load_segment(struct page *page, void *aux)
  * The pages initialized by this function must be writable by the
  * user process if WRITABLE is true, read-only otherwise.
  *
+ * Nothing is read here: each page is added as an uninit page that
+ * lazy_load_segment() fills on the first fault on it, and the
+ * segment becomes a region with its own handle on FILE, which
+ * stays open as long as the region.
+ *
  * Return true if successful, false if a memory allocation error
- * or disk read error occurs. */
+ * occurs. */
 static bool
 load_segment(struct file *file, off_t ofs, uint8_t *upage,
 						 uint32_t read_bytes, uint32_t zero_bytes, bool writable)
 {
+	struct vm_region *region;
+
 	ASSERT((read_bytes + zero_bytes) % PGSIZE == 0);
 	ASSERT(pg_ofs(upage) == 0);
 	ASSERT(ofs % PGSIZE == 0);
 
+	region = spt_add_region(&thread_current()->spt, upage,
+													upage + read_bytes + zero_bytes,
+													writable ? VM_REGION_DATA : VM_REGION_CODE);
+	if (region == NULL)
+		return false;
+	region->file = file_reopen(file);
+	if (region->file == NULL)
+		return false;
+
 	while (read_bytes > 0 || zero_bytes > 0)
 	{
 		/* Do calculate how to fill this page.
@@ -748,31 +809,51 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
 		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 		size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		void *aux = NULL;
-		if (!vm_alloc_page_with_initializer(VM_ANON, upage,
-																				writable, lazy_load_segment, aux))
+		/* Pages past the end of the file part need no initializer;
+		 * they are fresh anonymous memory. */
+		struct file_page *aux = NULL;
+		if (page_read_bytes > 0)
+		{
+			aux = malloc(sizeof *aux);
+			if (aux == NULL)
+				return false;
+			aux->file = region->file;
+			aux->offset = ofs;
+			aux->read_bytes = page_read_bytes;
+		}
+		if (!vm_alloc_page_with_initializer(VM_ANON, upage, writable,
+																				aux != NULL ? lazy_load_segment : NULL, aux))
+		{
+			free(aux);
 			return false;
+		}
 
 		/* Advance. */
 		read_bytes -= page_read_bytes;
 		zero_bytes -= page_zero_bytes;
+		ofs += page_read_bytes;
 		upage += PGSIZE;
 	}
 	return true;
 }
 
-/* Create a PAGE of stack at the USER_STACK. Return true on success. */
+/* Create a PAGE of stack at the USER_STACK. Return true on success.
+ * The page is claimed at once, since the arguments are pushed onto
+ * it right away; it is marked as stack by its region. */
 static bool
 setup_stack(struct intr_frame *if_)
 {
 	bool success = false;
 	void *stack_bottom = (void *)(((uint8_t *)USER_STACK) - PGSIZE);
 
-	/* TODO: Map the stack on stack_bottom and claim the page immediately.
-	 * TODO: If success, set the rsp accordingly.
-	 * TODO: You should mark the page is stack. */
-	/* TODO: Your code goes here */
+	if (spt_add_region(&thread_current()->spt, stack_bottom,
+										 (void *)USER_STACK, VM_REGION_STACK) != NULL
+			&& vm_alloc_page(VM_ANON, stack_bottom, true)
+			&& vm_claim_page(stack_bottom))
+	{
+		if_->rsp = USER_STACK;
+		success = true;
+	}
 
 	return success;
 }
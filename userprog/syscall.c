@@ -4,6 +4,7 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/loader.h"
+#include "threads/mp.h"
 #include "userprog/gdt.h"
 #include "threads/flags.h"
 #include "intrinsic.h"
@@ -41,6 +42,7 @@ bool filesys_create (const char *name, off_t initial_size); // 추가
 #define MSR_STAR 0xc0000081         /* Segment selector msr: 시스템 콜을 실행할 때 코드 세그먼트의 기준을 설정합니다. 여기서 사용자 모드와 커널 모드 간의 세그먼트 전환이 정의됩니다.*/
 #define MSR_LSTAR 0xc0000082        /* Long mode SYSCALL target: 시스템 콜이 발생했을 때 실행될 함수(시스템 콜 핸들러)의 주소를 설정 */
 #define MSR_SYSCALL_MASK 0xc0000084 /* Mask for the eflags: 시스템 콜이 진행될 때 마스킹될 플래그를 정의합니다. 이 마스킹은 시스템 콜 처리 중에 발생할 수 있는 인터럽트를 방지하기 위해 사용됩니다. */
+#define MSR_KERNEL_GS_BASE 0xc0000102 /* GS base swapped in by swapgs: syscall_entry가 CPU별 데이터를 찾는 데 사용합니다. */
 
 /*
  * syscall_init 함수는 운영체제의 시스템 콜 인터페이스를 초기화합니다.
@@ -53,6 +55,15 @@ bool filesys_create (const char *name, off_t initial_size); // 추가
  */
 void
 syscall_init (void) 
+{
+	syscall_init_cpu ();
+}
+
+/* Sets up the running CPU's MSRs for the syscall instruction.
+ * syscall_init() does it for the boot CPU; every other CPU calls
+ * this when it starts. */
+void
+syscall_init_cpu (void)
 {
 	/* 시스템 콜에 대한 MSR 레지스터를 설정합니다.
 	 * 이 때 SEL_UCSEG(사용자 코드 세그먼트 셀렉터)에서 0x10을 빼고 48비트를 왼쪽으로 시프트하고,
@@ -71,6 +82,9 @@ syscall_init (void)
 	 */
 	write_msr(MSR_SYSCALL_MASK,
 			FLAG_IF | FLAG_TF | FLAG_DF | FLAG_IOPL | FLAG_AC | FLAG_NT);
+
+	/* syscall_entry가 swapgs로 이 CPU의 struct cpu를 찾도록 합니다. */
+	write_msr(MSR_KERNEL_GS_BASE, (uint64_t) cpu_current ());
 }
 
 /* The main system call interface */
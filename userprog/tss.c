@@ -2,6 +2,8 @@
 #include <debug.h>
 #include <stddef.h>
 #include "userprog/gdt.h"
+#include "threads/kstack.h"
+#include "threads/mp.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -43,32 +45,53 @@
  *      not in use, so we can always use that.  Thus, when the
  *      scheduler switches threads, it also changes the TSS's
  *      stack pointer to point to the new thread's kernel stack.
- *      (The call is in schedule in thread.c.) */
-
-/* Kernel TSS. */
-struct task_state *tss;
+ *      (The call is in schedule in thread.c.)
+ *
+ *  Each CPU has a TSS of its own, in its struct cpu, since each
+ *  runs a different thread.
+ *
+ *  The TSS also holds the interrupt stack table, stacks that the
+ *  CPU switches to for particular interrupts no matter which ring
+ *  it was in.  We use one of them for double faults, which is how
+ *  a kernel stack that overflows into its guard page gets
+ *  reported (see threads/interrupt.c). */
 
-/* Initializes the kernel TSS. */
+/* Initializes the kernel TSS of every CPU.  Must be called after
+ * mp_init(). */
 void
 tss_init (void) {
 	/* Our TSS is never used in a call gate or task gate, so only a
 	 * few fields of it are ever referenced, and those are the only
 	 * ones we initialize. */
-	tss = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+	for (int i = 0; i < cpu_cnt; i++) {
+		struct task_state *tss = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+		void *df_stack = kstack_alloc ();
+
+		if (df_stack == NULL)
+			PANIC ("tss_init: out of memory");
+		tss->ist1 = KSTACK_TOP (df_stack);
+		cpus[i].tss = tss;
+	}
 	tss_update (thread_current ());
 }
 
-/* Returns the kernel TSS. */
+/* Returns the running CPU's kernel TSS. */
 struct task_state *
 tss_get (void) {
+	struct task_state *tss = cpu_current ()->tss;
+
 	ASSERT (tss != NULL);
 	return tss;
 }
 
-/* Sets the ring 0 stack pointer in the TSS to point to the end
- * of the thread stack. */
+/* Sets the ring 0 stack pointer in the running CPU's TSS to point
+ * to the end of the thread stack.  Also makes NEXT the owner of
+ * the double fault stack, so that running_thread() still finds
+ * NEXT while a double fault is handled. */
 void
 tss_update (struct thread *next) {
-	ASSERT (tss != NULL);
-	tss->rsp0 = (uint64_t) next + PGSIZE;
+	struct task_state *tss = tss_get ();
+
+	tss->rsp0 = KSTACK_TOP (next->stack);
+	*kstack_owner (tss->ist1) = next;
 }
@@ -1,7 +1,12 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
+#include <bitmap.h>
+#include <string.h>
 #include "vm/vm.h"
 #include "devices/disk.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
@@ -17,36 +22,213 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
+/* Swap space.
+
+   The swap disk is divided into page-sized slots of
+   SECTORS_PER_SLOT sectors each.  A bitmap has a bit per slot,
+   set if the slot is in use.  Slots are handed out first fit,
+   starting from a hint: the lowest slot that may be free.
+   Allocation moves the hint past the slot it returns, and freeing
+   a slot below the hint moves the hint back to it, so most
+   allocations find a free slot at the hint itself.
+
+   Pages go to and from swap in clusters of up to SWAP_CLUSTER.
+   Eviction gathers several victims and writes them to a run of
+   adjacent slots with one multi-sector disk command, and a fault
+   on a swapped-out page reads in, with the same command, the
+   pages in the slots after it that belong to the same process, on
+   the bet that they were evicted together and will be used
+   together.  For that, each slot in use records its page and the
+   page's address space. */
+
+/* Sectors in a swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / DISK_SECTOR_SIZE)
+
+/* A swap slot in use. */
+struct swap_slot {
+	struct page *page;                  /* Page in the slot. */
+	uint64_t *pml4;                     /* Address space of PAGE. */
+};
+
+static struct bitmap *swap_map;         /* Slots in use. */
+static struct swap_slot *slots;         /* Owners of slots in use. */
+static size_t swap_hint;                /* No free slot below this. */
+static struct lock swap_lock;           /* Protects the above. */
+
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
-	/* TODO: Set up the swap_disk. */
-	swap_disk = NULL;
+	swap_disk = disk_get (1, 1);
+	lock_init (&swap_lock);
+	if (swap_disk == NULL)
+		return;
+	size_t slot_cnt = disk_size (swap_disk) / SECTORS_PER_SLOT;
+	swap_map = bitmap_create (slot_cnt);
+	slots = calloc (slot_cnt, sizeof *slots);
+	if (swap_map == NULL || slots == NULL)
+		PANIC ("vm_anon_init: out of memory");
+}
+
+/* Finds CNT adjacent free swap slots, marks them used, and
+   returns the first, or SWAP_SLOT_NONE if swap has no such run or
+   there is no swap disk. */
+static size_t
+slot_alloc (size_t cnt) {
+	size_t slot;
+
+	if (swap_map == NULL)
+		return SWAP_SLOT_NONE;
+
+	lock_acquire (&swap_lock);
+	slot = bitmap_scan_and_flip (swap_map, swap_hint, cnt, false);
+	if (slot != BITMAP_ERROR && (cnt == 1 || slot == swap_hint))
+		swap_hint = slot + cnt;
+	lock_release (&swap_lock);
+	return slot != BITMAP_ERROR ? slot : SWAP_SLOT_NONE;
+}
+
+/* Marks swap SLOT free. */
+static void
+slot_free (size_t slot) {
+	lock_acquire (&swap_lock);
+	ASSERT (bitmap_test (swap_map, slot));
+	bitmap_reset (swap_map, slot);
+	slots[slot].page = NULL;
+	if (slot < swap_hint)
+		swap_hint = slot;
+	lock_release (&swap_lock);
 }
 
 /* Initialize the file mapping */
 bool
-anon_initializer (struct page *page, enum vm_type type, void *kva) {
+anon_initializer (struct page *page, enum vm_type type UNUSED, void *kva) {
 	/* Set up the handler */
 	page->operations = &anon_ops;
+	page->anon.slot = SWAP_SLOT_NONE;
 
-	struct anon_page *anon_page = &page->anon;
+	/* The frame may have held another process's data. */
+	memset (kva, 0, PGSIZE);
+	return true;
+}
+
+/* Reads swapped-out PAGE into KVA, leaving it in swap too. */
+void
+anon_read_swap (struct page *page, void *kva) {
+	ASSERT (page->anon.slot != SWAP_SLOT_NONE);
+	disk_read_multiple (swap_disk, page->anon.slot * SECTORS_PER_SLOT,
+			SECTORS_PER_SLOT, kva);
+}
+
+/* Writes the CNT anonymous pages in PAGES, which must be in
+   frames and unmapped, to swap, in runs of adjacent slots with one
+   disk command per run.  Runs are as long as free slots allow.
+   Returns the number of pages written, which are the first ones
+   in PAGES; the rest did not fit. */
+size_t
+anon_swap_out_cluster (struct page *pages[], size_t cnt) {
+	const void *bufs[SWAP_CLUSTER * SECTORS_PER_SLOT];
+	size_t done = 0;
+	size_t run = cnt;
+
+	ASSERT (cnt <= SWAP_CLUSTER);
+
+	while (done < cnt && run > 0) {
+		size_t slot;
+
+		run = run < cnt - done ? run : cnt - done;
+		slot = slot_alloc (run);
+		if (slot == SWAP_SLOT_NONE) {
+			run /= 2;
+			continue;
+		}
+
+		for (size_t i = 0; i < run; i++) {
+			struct page *page = pages[done + i];
+
+			for (size_t j = 0; j < SECTORS_PER_SLOT; j++)
+				bufs[i * SECTORS_PER_SLOT + j] =
+					(uint8_t *) page->frame->kva + j * DISK_SECTOR_SIZE;
+			page->anon.slot = slot + i;
+			slots[slot + i].page = page;
+			slots[slot + i].pml4 = page->frame->pml4;
+		}
+		disk_write_gather (swap_disk, slot * SECTORS_PER_SLOT,
+				run * SECTORS_PER_SLOT, bufs);
+		done += run;
+	}
+	return done;
+}
+
+/* Stores in AROUND the pages, up to MAX, in the swap slots just
+   after swapped-out PAGE's that belong to the same address space,
+   stopping at the first slot that does not, and returns how many
+   it stored.  The caller must keep pages from being freed or
+   swapped in meanwhile. */
+size_t
+anon_swap_around (struct page *page, struct page *around[], size_t max) {
+	size_t slot = page->anon.slot;
+	size_t cnt = 0;
+
+	ASSERT (slot != SWAP_SLOT_NONE);
+
+	lock_acquire (&swap_lock);
+	while (cnt < max && slot + cnt + 1 < bitmap_size (swap_map)) {
+		struct swap_slot *s = &slots[slot + cnt + 1];
+
+		if (s->page == NULL || s->pml4 != slots[slot].pml4)
+			break;
+		around[cnt++] = s->page;
+	}
+	lock_release (&swap_lock);
+	return cnt;
+}
+
+/* Reads the CNT swapped-out pages in PAGES, which must be in
+   adjacent slots in order, into KVAS, with one disk command, and
+   frees their slots. */
+void
+anon_swap_in_cluster (struct page *pages[], void *kvas[], size_t cnt) {
+	void *bufs[SWAP_CLUSTER * SECTORS_PER_SLOT];
+	size_t slot = pages[0]->anon.slot;
+
+	ASSERT (cnt > 0 && cnt <= SWAP_CLUSTER);
+
+	for (size_t i = 0; i < cnt; i++) {
+		ASSERT (pages[i]->anon.slot == slot + i);
+		for (size_t j = 0; j < SECTORS_PER_SLOT; j++)
+			bufs[i * SECTORS_PER_SLOT + j] =
+				(uint8_t *) kvas[i] + j * DISK_SECTOR_SIZE;
+	}
+	disk_read_scatter (swap_disk, slot * SECTORS_PER_SLOT,
+			cnt * SECTORS_PER_SLOT, bufs);
+	for (size_t i = 0; i < cnt; i++) {
+		slot_free (slot + i);
+		pages[i]->anon.slot = SWAP_SLOT_NONE;
+	}
 }
 
 /* Swap in the page by read contents from the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
-	struct anon_page *anon_page = &page->anon;
+	if (page->anon.slot == SWAP_SLOT_NONE) {
+		memset (kva, 0, PGSIZE);
+		return true;
+	}
+	anon_swap_in_cluster (&page, &kva, 1);
+	return true;
 }
 
 /* Swap out the page by writing contents to the swap disk. */
 static bool
 anon_swap_out (struct page *page) {
-	struct anon_page *anon_page = &page->anon;
+	return anon_swap_out_cluster (&page, 1) == 1;
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	if (anon_page->slot != SWAP_SLOT_NONE)
+		slot_free (anon_page->slot);
 }
@@ -1,5 +1,10 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
+#include <round.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
 
 static bool file_backed_swap_in (struct page *page, void *kva);
@@ -21,38 +26,118 @@ vm_file_init (void) {
 
 /* Initialize the file backed page */
 bool
-file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
+file_backed_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &file_ops;
+	memset (&page->file, 0, sizeof page->file);
+	return true;
+}
+
+/* Lazy initializer for a page of a mapping: AUX is a struct
+ * file_page that says where the page's data is. */
+static bool
+lazy_load_file (struct page *page, void *aux) {
+	page->file = *(struct file_page *) aux;
+	free (aux);
+	return file_backed_swap_in (page, page->frame->kva);
+}
 
+/* Writes PAGE back to its file if it has been modified. */
+static void
+write_back (struct page *page) {
 	struct file_page *file_page = &page->file;
+	uint64_t *pml4 = page->frame->pml4;
+
+	if (pml4_is_dirty (pml4, page->va)) {
+		file_write_at (file_page->file, page->frame->kva,
+				file_page->read_bytes, file_page->offset);
+		pml4_set_dirty (pml4, page->va, false);
+	}
 }
 
 /* Swap in the page by read contents from the file. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+
+	if (file_read_at (file_page->file, kva, file_page->read_bytes,
+				file_page->offset) != (off_t) file_page->read_bytes)
+		return false;
+	memset ((uint8_t *) kva + file_page->read_bytes, 0,
+			PGSIZE - file_page->read_bytes);
+	return true;
 }
 
 /* Swap out the page by writeback contents to the file. */
 static bool
 file_backed_swap_out (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	write_back (page);
+	return true;
 }
 
 /* Destory the file backed page. PAGE will be freed by the caller. */
 static void
 file_backed_destroy (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	if (page->frame != NULL)
+		write_back (page);
 }
 
 /* Do the mmap */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *start = addr;
+	uint8_t *end = start + ROUND_UP (length, PGSIZE);
+	struct vm_region *region;
+	off_t file_len;
+	uint8_t *upage;
+
+	if (start == NULL || pg_ofs (start) != 0 || offset % PGSIZE != 0
+			|| length == 0 || end <= start || !is_user_vaddr (end - 1))
+		return NULL;
+	file_len = file_length (file);
+	if (file_len == 0 || !spt_range_is_free (spt, start, end))
+		return NULL;
+
+	region = spt_add_region (spt, start, end, VM_REGION_MMAP);
+	if (region == NULL)
+		return NULL;
+	region->file = file_reopen (file);
+	if (region->file == NULL)
+		goto fail;
+
+	for (upage = start; upage < end; upage += PGSIZE) {
+		off_t ofs = offset + (upage - start);
+		struct file_page *aux = malloc (sizeof *aux);
+
+		if (aux == NULL)
+			goto fail;
+		aux->file = region->file;
+		aux->offset = ofs;
+		aux->read_bytes = ofs >= file_len ? 0
+			: file_len - ofs < PGSIZE ? (size_t) (file_len - ofs) : PGSIZE;
+		if (!vm_alloc_page_with_initializer (VM_FILE, upage, writable,
+					lazy_load_file, aux)) {
+			free (aux);
+			goto fail;
+		}
+	}
+	return start;
+
+fail:
+	spt_remove_region (spt, region);
+	return NULL;
 }
 
 /* Do the munmap */
 void
 do_munmap (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vm_region *region = spt_find_region (spt, addr);
+
+	if (region != NULL && region->kind == VM_REGION_MMAP
+			&& region->start == addr)
+		spt_remove_region (spt, region);
 }
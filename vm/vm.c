@@ -1,9 +1,47 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
 #include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
 
+/* Allocate struct page and struct frame. */
+static struct kmem_cache *page_cache;
+static struct kmem_cache *frame_cache;
+
+/* Frame table: every frame that holds a user page, in the order
+ * the CLOCK hand visits them.  When the user pool runs out, the
+ * hand sweeps around the table, giving each frame whose page has
+ * been accessed since the last sweep a second chance by clearing
+ * its accessed bit, and evicts the first frame whose page has
+ * not.  New frames go in just behind the hand, so they are the
+ * last to be looked at.
+ *
+ * FRAME_LOCK protects the table and serializes claiming, evicting
+ * and freeing pages, so that a page cannot be evicted while it is
+ * being brought in or freed. */
+static struct list frame_table;
+static struct list_elem *clock_hand;
+static struct lock frame_lock;
+
+/* Pages in a 2 MB huge page. */
+#define HUGE_PAGES (HUGE_PGSIZE / PGSIZE)
+
+/* Huge page statistics. */
+static uint64_t huge_hits;      /* Faults served with a 2 MB page. */
+static uint64_t huge_misses;    /* Eligible, but no 2 MB block free. */
+
+/* Swap clustering statistics. */
+static uint64_t swap_clusters;  /* Evictions that wrote several pages. */
+static uint64_t swap_ahead;     /* Pages read in ahead of a fault. */
+
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
 void
@@ -15,7 +53,29 @@ vm_init (void) {
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
-	/* TODO: Your code goes here. */
+	page_cache = kmem_cache_create ("page", sizeof (struct page), 0, NULL);
+	frame_cache = kmem_cache_create ("frame", sizeof (struct frame), 0, NULL);
+	if (page_cache == NULL || frame_cache == NULL)
+		PANIC ("vm_init: out of memory");
+	list_init (&frame_table);
+	clock_hand = list_end (&frame_table);
+	lock_init (&frame_lock);
+}
+
+/* Adds FRAME to the frame table, just behind the clock hand. */
+static void
+frame_table_insert (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	list_insert (clock_hand, &frame->elem);
+}
+
+/* Removes FRAME from the frame table. */
+static void
+frame_table_remove (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	if (clock_hand == &frame->elem)
+		clock_hand = list_next (clock_hand);
+	list_remove (&frame->elem);
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -36,6 +96,7 @@ page_get_type (struct page *page) {
 static struct frame *vm_get_victim (void);
 static bool vm_do_claim_page (struct page *page);
 static struct frame *vm_evict_frame (void);
+static void vm_free_frame (struct frame *frame);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -50,74 +111,384 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 
 	/* Check wheter the upage is already occupied or not. */
 	if (spt_find_page (spt, upage) == NULL) {
-		/* TODO: Create the page, fetch the initialier according to the VM type,
-		 * TODO: and then create "uninit" page struct by calling uninit_new. You
-		 * TODO: should modify the field after calling the uninit_new. */
-
-		/* TODO: Insert the page into the spt. */
+		bool (*initializer) (struct page *, enum vm_type, void *);
+		struct page *page;
+
+		switch (VM_TYPE (type)) {
+			case VM_ANON:
+				initializer = anon_initializer;
+				break;
+			case VM_FILE:
+				initializer = file_backed_initializer;
+				break;
+			default:
+				goto err;
+		}
+
+		page = kmem_cache_alloc (page_cache);
+		if (page == NULL)
+			goto err;
+		uninit_new (page, upage, init, type, aux, initializer);
+		page->writable = writable;
+
+		if (!spt_insert_page (spt, page)) {
+			kmem_cache_free (page_cache, page);
+			goto err;
+		}
+		return true;
 	}
 err:
 	return false;
 }
 
+/* Returns a hash value for the page that E is in. */
+static uint64_t
+page_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct page *page = hash_entry (e, struct page, spt_elem);
+	return hash_bytes (&page->va, sizeof page->va);
+}
+
+/* Returns true if the page that A is in precedes the one B is in. */
+static bool
+page_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	const struct page *pa = hash_entry (a, struct page, spt_elem);
+	const struct page *pb = hash_entry (b, struct page, spt_elem);
+	return pa->va < pb->va;
+}
+
 /* Find VA from spt and return page. On error, return NULL. */
 struct page *
-spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function. */
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	struct page key;
+	struct hash_elem *e;
 
-	return page;
+	key.va = pg_round_down (va);
+	e = hash_find (&spt->pages, &key.spt_elem);
+	return e != NULL ? hash_entry (e, struct page, spt_elem) : NULL;
 }
 
 /* Insert PAGE into spt with validation. */
 bool
-spt_insert_page (struct supplemental_page_table *spt UNUSED,
-		struct page *page UNUSED) {
-	int succ = false;
-	/* TODO: Fill this function. */
-
-	return succ;
+spt_insert_page (struct supplemental_page_table *spt, struct page *page) {
+	ASSERT (pg_ofs (page->va) == 0);
+	return hash_insert (&spt->pages, &page->spt_elem) == NULL;
 }
 
+/* Removes PAGE from SPT and frees it. */
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
+	hash_delete (&spt->pages, &page->spt_elem);
 	vm_dealloc_page (page);
+}
+
+/* Returns true if region A starts before region B. */
+static bool
+region_less (const struct list_elem *a, const struct list_elem *b,
+		void *aux UNUSED) {
+	return list_entry (a, struct vm_region, elem)->start
+		< list_entry (b, struct vm_region, elem)->start;
+}
+
+/* Adds a region of kind KIND that covers the pages in [START, END)
+ * to SPT, and returns it.  Returns a null pointer if the range
+ * overlaps a region already in SPT or memory is short.  Pages
+ * within the region are added separately. */
+struct vm_region *
+spt_add_region (struct supplemental_page_table *spt, void *start, void *end,
+		enum vm_region_kind kind) {
+	struct vm_region *region;
+
+	ASSERT (pg_ofs (start) == 0 && pg_ofs (end) == 0);
+	ASSERT (start < end);
+
+	if (!spt_range_is_free (spt, start, end))
+		return NULL;
+	region = malloc (sizeof *region);
+	if (region == NULL)
+		return NULL;
+	region->start = start;
+	region->end = end;
+	region->kind = kind;
+	region->file = NULL;
+	list_insert_ordered (&spt->regions, &region->elem, region_less, NULL);
+	return region;
+}
+
+/* Returns the region of SPT that contains ADDR, or a null pointer
+ * if there is none. */
+struct vm_region *
+spt_find_region (struct supplemental_page_table *spt, const void *addr) {
+	struct list_elem *e;
+
+	for (e = list_begin (&spt->regions); e != list_end (&spt->regions);
+			e = list_next (e)) {
+		struct vm_region *region = list_entry (e, struct vm_region, elem);
+		if ((const uint8_t *) addr < region->start)
+			break;
+		if ((const uint8_t *) addr < region->end)
+			return region;
+	}
+	return NULL;
+}
+
+/* Returns true if no region of SPT overlaps [START, END). */
+bool
+spt_range_is_free (struct supplemental_page_table *spt, const void *start,
+		const void *end) {
+	struct list_elem *e;
+
+	for (e = list_begin (&spt->regions); e != list_end (&spt->regions);
+			e = list_next (e)) {
+		struct vm_region *region = list_entry (e, struct vm_region, elem);
+		if ((const uint8_t *) end <= region->start)
+			break;
+		if ((const uint8_t *) start < region->end)
+			return false;
+	}
 	return true;
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Removes REGION from SPT and frees it along with every page in
+ * its range, writing back any changes to a mapped file. */
+void
+spt_remove_region (struct supplemental_page_table *spt,
+		struct vm_region *region) {
+	uint8_t *va;
+
+	for (va = region->start; va < region->end; va += PGSIZE) {
+		struct page *page = spt_find_page (spt, va);
+		if (page != NULL)
+			spt_remove_page (spt, page);
+	}
+	list_remove (&region->elem);
+	if (region->file != NULL)
+		file_close (region->file);
+	free (region);
+}
+
+/* Get the struct frame, that will be evicted.  Advances the
+ * clock hand to the first frame whose page has not been accessed
+ * since the hand last passed, clearing accessed bits on the way.
+ * After two full turns every bit has been cleared once, so if
+ * pages keep being accessed behind the hand, takes the frame
+ * under it anyway. */
 static struct frame *
 vm_get_victim (void) {
+	size_t limit = 2 * list_size (&frame_table);
 	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
 
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	while (!list_empty (&frame_table)) {
+		if (clock_hand == list_end (&frame_table))
+			clock_hand = list_begin (&frame_table);
+		victim = list_entry (clock_hand, struct frame, elem);
+		clock_hand = list_next (clock_hand);
+
+		if (limit-- == 0
+				|| !pml4_is_accessed (victim->pml4, victim->page->va))
+			break;
+		pml4_set_accessed (victim->pml4, victim->page->va, false);
+	}
+	return victim;
+}
+
+/* Takes VICTIM out of the frame table and unmaps its page, so
+ * that the owner cannot change the page while it is written out.
+ * The dirty bit survives.
+ *
+ * Returns false, leaving VICTIM as it was, if its owner is running
+ * on another CPU, whose TLB we have no way to flush, or if its 2 MB
+ * page could not be split.  Once the page is unmapped, the owner
+ * gets a fresh TLB wherever it runs next (see pml4_invalidate()),
+ * so the check and the unmapping are done with interrupts off,
+ * which keeps the owner from being loaded in between. */
+static bool
+unmap_victim (struct frame *victim) {
+	enum intr_level old_level = intr_disable ();
+	bool success = !pml4_is_loaded_elsewhere (victim->pml4)
+		&& pml4_clear_page (victim->pml4, victim->page->va);
+
+	intr_set_level (old_level);
+	if (success)
+		frame_table_remove (victim);
+	return success;
+}
+
+/* Undoes unmap_victim (VICTIM), for a page that could not be
+ * written out. */
+static void
+restore_victim (struct frame *victim) {
+	struct page *page = victim->page;
+
+	pml4_set_page (victim->pml4, page->va, victim->kva, page->writable);
+	frame_table_insert (victim);
+}
+
+/* Evicts VICTIM, which has been unmapped and whose page is not
+ * anonymous, and returns it, or returns a null pointer and puts it
+ * back if its page cannot be written out. */
+static struct frame *
+evict_single (struct frame *victim) {
+	struct page *page = victim->page;
+
+	if (!swap_out (page)) {
+		restore_victim (victim);
+		return NULL;
+	}
+	page->frame = NULL;
+	victim->page = NULL;
 	return victim;
 }
 
+/* Evicts VICTIM, which has been unmapped and whose page is
+ * anonymous, along with the anonymous pages that the clock hand
+ * comes to next, up to SWAP_CLUSTER in all, and writes them to
+ * swap together.  The other frames go back to the user pool, so
+ * the faults that follow do not have to evict.  Returns VICTIM, or
+ * a null pointer and puts it back if it could not be swapped
+ * out. */
+static struct frame *
+evict_cluster (struct frame *victim) {
+	struct frame *victims[SWAP_CLUSTER];
+	struct page *pages[SWAP_CLUSTER];
+	size_t cnt, done, i;
+
+	cnt = 0;
+	do {
+		victims[cnt] = victim;
+		pages[cnt++] = victim->page;
+		victim = vm_get_victim ();
+	} while (cnt < SWAP_CLUSTER && victim != NULL
+			&& page_get_type (victim->page) == VM_ANON
+			&& unmap_victim (victim));
+
+	done = anon_swap_out_cluster (pages, cnt);
+	if (done > 1)
+		swap_clusters++;
+	for (i = 0; i < cnt; i++) {
+		if (i >= done) {
+			restore_victim (victims[i]);
+			continue;
+		}
+		pages[i]->frame = NULL;
+		victims[i]->page = NULL;
+		if (i > 0)
+			vm_free_frame (victims[i]);
+	}
+	return done > 0 ? victims[0] : NULL;
+}
+
 /* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+ * Return NULL on error.
+ *
+ * A victim that cannot be evicted stays where it is, and the clock
+ * hand moves on to the next one, until every frame has had a turn.
+ * Once an anonymous page fails to go out, swap is full or missing,
+ * so only pages of other kinds are tried after that. */
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
-
+	size_t tries = list_size (&frame_table);
+	bool anon_ok = true;
+
+	while (tries-- > 0) {
+		struct frame *victim = vm_get_victim ();
+		struct frame *frame;
+
+		if (victim == NULL)
+			return NULL;
+		if (page_get_type (victim->page) != VM_ANON) {
+			if (unmap_victim (victim)
+					&& (frame = evict_single (victim)) != NULL)
+				return frame;
+		} else if (anon_ok && unmap_victim (victim)) {
+			frame = evict_cluster (victim);
+			if (frame != NULL)
+				return frame;
+			anon_ok = false;
+		}
+	}
 	return NULL;
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
- * and return it. This always return valid address. That is, if the user pool
- * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * and return it.  Returns a null pointer only if nothing can be
+ * evicted. */
 static struct frame *
 vm_get_frame (void) {
-	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
-
-	ASSERT (frame != NULL);
-	ASSERT (frame->page == NULL);
+	void *kva = palloc_get_page (PAL_USER);
+	struct frame *frame;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (kva != NULL) {
+		frame = kmem_cache_alloc (frame_cache);
+		ASSERT (frame != NULL);
+		frame->kva = kva;
+	} else {
+		frame = vm_evict_frame ();
+		if (frame == NULL)
+			return NULL;
+	}
+	frame->page = NULL;
+	frame->pml4 = thread_current ()->pml4;
 	return frame;
 }
 
+/* Frees FRAME, which is not in the frame table. */
+static void
+vm_free_frame (struct frame *frame) {
+	palloc_free_page (frame->kva);
+	kmem_cache_free (frame_cache, frame);
+}
+
+/* Reads swapped-out anonymous PAGE into FRAME, along with the
+ * pages swapped out just after it in the same region, into frames
+ * of their own, as far as the user pool has free frames for them
+ * without evicting.  The pages read ahead are mapped at once; the
+ * faulting process is blocked in this fault, so it cannot see them
+ * before they are read. */
+static void
+vm_swap_in_around (struct page *page, struct frame *frame) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vm_region *region = spt_find_region (spt, page->va);
+	struct page *pages[SWAP_CLUSTER];
+	void *kvas[SWAP_CLUSTER];
+	size_t cnt = 1, around, i;
+
+	pages[0] = page;
+	kvas[0] = frame->kva;
+	around = region != NULL
+		? anon_swap_around (page, pages + 1, SWAP_CLUSTER - 1) : 0;
+	for (i = 1; i <= around; i++) {
+		struct page *p = pages[i];
+		struct frame *f;
+
+		if (spt_find_region (spt, p->va) != region)
+			break;
+		kvas[i] = palloc_get_page (PAL_USER);
+		if (kvas[i] == NULL)
+			break;
+		if (!pml4_set_page (frame->pml4, p->va, kvas[i], p->writable)) {
+			palloc_free_page (kvas[i]);
+			break;
+		}
+		f = kmem_cache_alloc (frame_cache);
+		ASSERT (f != NULL);
+		f->kva = kvas[i];
+		f->page = p;
+		f->pml4 = frame->pml4;
+		p->frame = f;
+		cnt++;
+	}
+
+	anon_swap_in_cluster (pages, kvas, cnt);
+	for (i = 1; i < cnt; i++)
+		frame_table_insert (pages[i]->frame);
+	swap_ahead += cnt - 1;
+}
+
 /* Growing the stack. */
 static void
 vm_stack_growth (void *addr UNUSED) {
@@ -130,61 +501,274 @@ vm_handle_wp (struct page *page UNUSED) {
 
 /* Return true on success */
 bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
-		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
+vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr,
+		bool user UNUSED, bool write, bool not_present) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
 	struct page *page = NULL;
-	/* TODO: Validate the fault */
-	/* TODO: Your code goes here */
+
+	if (!not_present || !is_user_vaddr (addr))
+		return false;
+	page = spt_find_page (spt, pg_round_down (addr));
+	if (page == NULL || (write && !page->writable))
+		return false;
 
 	return vm_do_claim_page (page);
 }
 
-/* Free the page.
- * DO NOT MODIFY THIS FUNCTION. */
+/* Free the page, and its frame if it has one. */
 void
 vm_dealloc_page (struct page *page) {
+	lock_acquire (&frame_lock);
 	destroy (page);
-	free (page);
+	if (page->frame != NULL) {
+		/* Only fresh anonymous pages are put in 2 MB pages, and
+		 * those are freed only with their whole address space,
+		 * whose 2 MB pages supplemental_page_table_kill() unmaps
+		 * first.  So there is nothing to split here. */
+		bool cleared = pml4_clear_page (page->frame->pml4, page->va);
+		ASSERT (cleared);
+		frame_table_remove (page->frame);
+		vm_free_frame (page->frame);
+	}
+	lock_release (&frame_lock);
+	kmem_cache_free (page_cache, page);
 }
 
 /* Claim the page that allocate on VA. */
 bool
-vm_claim_page (void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function */
+vm_claim_page (void *va) {
+	struct page *page = spt_find_page (&thread_current ()->spt, va);
 
+	if (page == NULL)
+		return false;
 	return vm_do_claim_page (page);
 }
 
+/* Returns true if PAGE is an anonymous page that has never been
+ * touched and needs no initializer, so that zeroed memory is all
+ * it takes to bring it in. */
+static bool
+is_fresh_anon (const struct page *page) {
+	return page->operations->type == VM_UNINIT
+		&& VM_TYPE (page->uninit.type) == VM_ANON
+		&& page->uninit.init == NULL;
+}
+
+/* Tries to claim PAGE, and the rest of the aligned 2 MB of user
+ * memory around it, with one 2 MB page.  That works only if every
+ * page in the 2 MB is a fresh anonymous page with the same access
+ * as PAGE, and the user pool has a free 2 MB block.  Returns true
+ * if successful, false if PAGE should be claimed by itself. */
+static bool
+vm_claim_huge (struct page *page) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *base = (uint8_t *) ROUND_DOWN ((uint64_t) page->va, HUGE_PGSIZE);
+	uint8_t *kva;
+	size_t i;
+
+	if (!is_fresh_anon (page))
+		return false;
+	for (i = 0; i < HUGE_PAGES; i++) {
+		struct page *p = spt_find_page (spt, base + i * PGSIZE);
+		if (p == NULL || !is_fresh_anon (p) || p->writable != page->writable)
+			return false;
+	}
+
+	kva = palloc_get_multiple (PAL_USER, HUGE_PAGES);
+	if (kva == NULL) {
+		huge_misses++;
+		return false;
+	}
+	if (!pml4_set_huge_page (thread_current ()->pml4, base, kva,
+				page->writable)) {
+		palloc_free_multiple (kva, HUGE_PAGES);
+		return false;
+	}
+
+	for (i = 0; i < HUGE_PAGES; i++) {
+		struct page *p = spt_find_page (spt, base + i * PGSIZE);
+		struct frame *frame = kmem_cache_alloc (frame_cache);
+
+		ASSERT (frame != NULL);
+		frame->kva = kva + i * PGSIZE;
+		frame->page = p;
+		frame->pml4 = thread_current ()->pml4;
+		p->frame = frame;
+		swap_in (p, frame->kva);
+		frame_table_insert (frame);
+	}
+	huge_hits++;
+	return true;
+}
+
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+	struct frame *frame;
+	bool success = true;
+
+	lock_acquire (&frame_lock);
+	if (page->frame != NULL || vm_claim_huge (page))
+		goto done;
+
+	frame = vm_get_frame ();
+	if (frame == NULL) {
+		success = false;
+		goto done;
+	}
 
 	/* Set links */
 	frame->page = page;
 	page->frame = frame;
 
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
+	/* Fill the frame before mapping it, so that the page is never
+	 * visible half loaded. */
+	if (page->operations->type == VM_ANON && page->anon.slot != SWAP_SLOT_NONE)
+		vm_swap_in_around (page, frame);
+	else if (!swap_in (page, frame->kva))
+		success = false;
+	if (success
+			&& pml4_set_page (frame->pml4, page->va, frame->kva, page->writable))
+		frame_table_insert (frame);
+	else {
+		page->frame = NULL;
+		vm_free_frame (frame);
+		success = false;
+	}
+done:
+	lock_release (&frame_lock);
+	return success;
+}
 
-	return swap_in (page, frame->kva);
+/* Prints virtual memory statistics. */
+void
+vm_print_stats (void) {
+	printf ("VM: %"PRIu64" huge page faults, %"PRIu64" fell back to "
+			"small pages, %"PRIu64" huge pages split\n",
+			huge_hits, huge_misses, huge_split_cnt);
+	printf ("VM: %"PRIu64" clustered swap writes, %"PRIu64" pages read "
+			"ahead\n", swap_clusters, swap_ahead);
 }
 
 /* Initialize new supplemental page table */
 void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	if (!hash_init (&spt->pages, page_hash, page_less, NULL))
+		PANIC ("supplemental_page_table_init: out of memory");
+	list_init (&spt->regions);
+}
+
+/* Copies SRC's page PAGE into DST, which belongs to the running
+ * thread.  A page that has not been brought in yet is copied as
+ * is, with its initializer; lazy initializers in this tree all
+ * take a struct file_page as AUX, which is copied too, pointing at
+ * DST's handle on the file of the region the page is in.  Any other
+ * page is brought in at once, with the same contents, which come
+ * from PAGE's frame, or from swap or its file if it was evicted. */
+static bool
+copy_page (struct supplemental_page_table *dst, struct page *page) {
+	enum vm_type type = page_get_type (page);
+	struct page *copy;
+
+	if (page->operations->type == VM_UNINIT) {
+		struct file_page *aux = page->uninit.aux;
+
+		if (aux != NULL) {
+			aux = malloc (sizeof *aux);
+			if (aux == NULL)
+				return false;
+			*aux = *(struct file_page *) page->uninit.aux;
+			aux->file = spt_find_region (dst, page->va)->file;
+		}
+		if (vm_alloc_page_with_initializer (page->uninit.type, page->va,
+					page->writable, page->uninit.init, aux))
+			return true;
+		free (aux);
+		return false;
+	}
+
+	if (!vm_alloc_page (type, page->va, page->writable))
+		return false;
+	copy = spt_find_page (dst, page->va);
+
+	/* Bring in COPY and hold it there while it is filled. */
+	do {
+		if (!vm_do_claim_page (copy))
+			return false;
+		lock_acquire (&frame_lock);
+		if (copy->frame == NULL)
+			lock_release (&frame_lock);
+	} while (copy->frame == NULL);
+
+	if (type == VM_FILE) {
+		copy->file = page->file;
+		copy->file.file = spt_find_region (dst, page->va)->file;
+	}
+	if (page->frame != NULL)
+		memcpy (copy->frame->kva, page->frame->kva, PGSIZE);
+	else if (type == VM_ANON)
+		anon_read_swap (page, copy->frame->kva);
+	else
+		swap_in (copy, copy->frame->kva);
+	lock_release (&frame_lock);
+	return true;
 }
 
 /* Copy supplemental page table from src to dst */
 bool
-supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
-		struct supplemental_page_table *src UNUSED) {
+supplemental_page_table_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	struct hash_iterator i;
+	struct list_elem *e;
+
+	for (e = list_begin (&src->regions); e != list_end (&src->regions);
+			e = list_next (e)) {
+		struct vm_region *region = list_entry (e, struct vm_region, elem);
+		struct vm_region *copy = spt_add_region (dst, region->start,
+				region->end, region->kind);
+
+		if (copy == NULL)
+			return false;
+		if (region->file != NULL
+				&& (copy->file = file_reopen (region->file)) == NULL)
+			return false;
+	}
+
+	hash_first (&i, &src->pages);
+	while (hash_next (&i))
+		if (!copy_page (dst, hash_entry (hash_cur (&i), struct page, spt_elem)))
+			return false;
+	return true;
 }
 
-/* Free the resource hold by the supplemental page table */
+/* Frees page E, for hash_clear(). */
+static void
+page_destructor (struct hash_elem *e, void *aux UNUSED) {
+	vm_dealloc_page (hash_entry (e, struct page, spt_elem));
+}
+
+/* Free the resource hold by the supplemental page table.  Leaves
+ * SPT empty, ready for another program to be loaded. */
 void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
-	/* TODO: Destroy all the supplemental_page_table hold by thread and
-	 * TODO: writeback all the modified contents to the storage. */
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
+	struct hash_iterator i;
+
+	/* Unmap 2 MB pages whole, so that freeing their 4 kB pieces
+	 * one by one below does not split each of them first. */
+	lock_acquire (&frame_lock);
+	hash_first (&i, &spt->pages);
+	while (hash_next (&i)) {
+		struct page *page = hash_entry (hash_cur (&i), struct page, spt_elem);
+
+		if (page->frame != NULL && (uint64_t) page->va % HUGE_PGSIZE == 0)
+			pml4_clear_huge_page (page->frame->pml4, page->va);
+	}
+	lock_release (&frame_lock);
+
+	while (!list_empty (&spt->regions))
+		spt_remove_region (spt, list_entry (list_front (&spt->regions),
+					struct vm_region, elem));
+
+	/* Pages outside of any region. */
+	hash_clear (&spt->pages, page_destructor);
 }